@@ -35,19 +35,28 @@
  *		Cleaned up code for distribution.
  */
 
+#include <ctype.h>
 #include <errno.h>
-#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "assert.h"
 #include "input.h"
 #include "modex.h"
 #include "photo.h"
+#include "prof.h"
+#include "render.h"
 #include "text.h"
+#include "wheel.h"
 #include "world.h"
 
 
@@ -66,12 +75,34 @@ static int sanity_check (void);
 #define TICK_USEC      50000 /* tick length in microseconds          */ 									
 #define STATUS_MSG_LEN 40    /* maximum length of status message     */
 #define MOTION_SPEED   2     /* pixels moved per command             */
-/*********		MAGIC NUMBERS WRITTEN BY ME  ******/
-#define STATUS_BAR_PIXEL_OFFSET	5760
-/*********	/////////////////////////////	*******/
+#define REDRAW_THREADS 0     /* redraw threads (0 for one per CPU)   */
+#define STATUS_MSG_NSEC 1500000000 /* status message display time (ns) */
+#define TICKS_PER_SEC  (1000000 / TICK_USEC)  /* ticks in one second   */
+#define REPLAY_SEED    391   /* random seed for replays              */
+
+/* 
+ * The replay program (REPLAY_PROGRAM) draws into an emulated VGA (see 
+ * modex.c) and reads no input, so it can only replay scripts (or run
+ * batch mode).
+ */
+#if defined(REPLAY_PROGRAM)
+#define CAN_PLAY 0
+#else
+#define CAN_PLAY 1
+#endif
+
 /* outcome of the game */
 typedef enum {GAME_WON, GAME_QUIT} game_condition_t;
 
+/* sources of events for the event loop (epoll data) */
+typedef enum {
+    EV_TICK,            /* frame tick timer expired            */
+    EV_STDIN,           /* keystrokes available                */
+    EV_TUX,             /* Tux controller data available       */
+    EV_STATUS_POSTED,   /* show_status posted a new message    */
+    NUM_EVENT_SOURCES
+} event_source_t;
+
 /* structure used to hold game information */
 typedef struct {
     room_t*      where;		 /* current room for player               */
@@ -132,79 +163,375 @@ static const typed_cmd_t cmd_list[] = {
     {NULL, 0, 0}
 };
 
+/* handler for a typed command verb (see world.h) */
+typedef tc_action_t (*tc_fn_t) (room_t** rptr, const char* arg);
+
+/* 
+ * Typed verbs are looked up in a trie over the (case-folded) letters of
+ * the verbs in cmd_list, built by build_cmd_trie.  Each node reached by
+ * an allowed abbreviation (of at least min_len characters) holds the 
+ * handler of the first command in cmd_list that it matches, so a lookup
+ * gives the same answer as comparing the verb with each command in turn.
+ */
+#define MAX_TRIE_NODES 128   /* at least the letters in all verbs, plus 1 */
+
+typedef struct cmd_node_t cmd_node_t;
+struct cmd_node_t {
+    uint8_t child[26]; /* child node for each letter (0 for none)     */
+    tc_fn_t fn;        /* handler for verb ending here (NULL if none) */
+};
+
 
 /* local functions--see function headers for details */
 
-static void cancel_status_thread (void* ignore);
+static void arm_timer (int tfd, int64_t first_ns, int64_t period_ns);
+static int32_t build_cmd_trie (void);
+static void close_events (void* ignore);
+static int32_t do_command (cmd_t cmd, const char* typed);
+static tc_action_t cmd_drop (room_t** rptr, const char* arg);
+static tc_action_t cmd_get (room_t** rptr, const char* arg);
+static void dump_frame_times (void* ignore);
+static void status_expired (void* need_draw);
+static void tux_clock (void* ignore);
 static game_condition_t game_loop (void);
-static int32_t handle_typing (void);
-static void init_game (void); 																														
+static int32_t handle_typing (const char* typed);
+static void init_game (void); 
+static tc_fn_t lookup_cmd (const char* verb, int32_t len);
+static int32_t open_events (void);
+static void read_status (char msg[STATUS_MSG_LEN + 1]);																														
 static void move_photo_left (void); 																												
 static void move_photo_right (void);																												
 static void move_photo_up (void);																													 
 static void move_photo_down (void); 																												
-static void redraw_room (void);																														
-static void* status_thread (void* ignore);
-static int time_is_after (struct timeval* t1, struct timeval* t2);
+static uint64_t game_now (void);
+static game_condition_t replay (const char* fname);
+static int run_batch (const char* fname, int32_t reps);
+static void update_screen (void);
+static int32_t watch_fd (int fd, event_source_t src);
+
+
+/* handler for each typed command */
+static const tc_fn_t cmd_fn[NUM_TC_VALUES] = {
+    [TC_BUY]       = typed_cmd_buy,
+    [TC_CHARGE]    = typed_cmd_charge,
+    [TC_DO]        = typed_cmd_do,
+    [TC_DRINK]     = typed_cmd_drink,
+    [TC_DROP]      = cmd_drop,
+    [TC_FIX]       = typed_cmd_fix,
+    [TC_FLASH]     = typed_cmd_flash,
+    [TC_GET]       = cmd_get,
+    [TC_GO]        = typed_cmd_go,
+    [TC_INSTALL]   = typed_cmd_install,
+    [TC_INVENTORY] = typed_cmd_inventory,
+    [TC_SIGH]      = typed_cmd_sigh,
+    [TC_USE]       = typed_cmd_use,
+    [TC_WEAR]      = typed_cmd_wear
+};
 
 
 /* file-scope variables */
 static game_info_t game_info; /* game information */
+static cmd_node_t cmd_trie[MAX_TRIE_NODES]; /* typed verbs; 0 is root */
+
+/* 
+ * When replaying a script, game time (used to time status messages) is
+ * the script's time rather than the monotonic clock, so replays do not
+ * depend on how fast they run.
+ */
+static int32_t replaying = 0;  /* a script is being replayed           */
+static uint64_t replay_ns = 0; /* script time, in nanoseconds          */
+
+/* 
+ * Arrival time (see prof_now) of the oldest input whose effect has not
+ * yet been sent to the render thread, or 0 if none.  The next frame
+ * carries it to show_screen to measure input-to-photon latency.
+ */
+static uint64_t input_ns = 0;
+
+/* names of commands in replay scripts, indexed by cmd_t */
+static const char* const replay_cmd_name[NUM_COMMANDS] = {
+    "none", "right", "left", "up", "down", "move_left", "enter", 
+    "move_right", "type", "quit"
+};
 int32_t enter_room;      																			
 
 /* 
- * The variables below are used to keep track of the status message helper
- * thread, with Posix thread id recorded in status_thread_id.  
- *
  * The status_msg records the current status message: when the
- * string recorded there is empty, no status message need be displayed, and
- * the status bar should instead reflect the name of the current room and the
- * player's typing (for typed commands).
+ * string recorded there is empty or its time has passed, no status 
+ * message need be displayed, and the status bar should instead reflect
+ * the name of the current room and the player's typing (for typed 
+ * commands).  The message is shown until the monotonic clock (prof_now)
+ * reaches msg_expires.
  *
- * The status_msg is protected by the msg_lock mutex, which should be
- * acquired before reading or writing the message.  Further, if the message
- * is changed, the helper thread must be notified by signaling it with the 
- * condition variable msg_cv (while holding the msg_lock).
- */
-static pthread_t status_thread_id;
-static pthread_mutex_t msg_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t  msg_cv = PTHREAD_COND_INITIALIZER;
+ * The message is published with a sequence lock rather than a mutex.  A
+ * writer (show_status, which any thread may call) claims msg_seq by
+ * making it odd with a compare-and-swap, changes the message and its 
+ * expiry time, and makes msg_seq even again.  Readers (read_status) never
+ * block: they copy the message and retry if msg_seq was odd or changed
+ * meanwhile.  After a change, the event loop is notified by writing to the
+ * eventfd status_fd, so that it can (re)start the timer at which the
+ * message disappears from the screen.
+ */
+static uint32_t msg_seq = 0;
+static uint64_t msg_expires = 0;
 static char status_msg[STATUS_MSG_LEN + 1] = {'\0'};
 
+/*
+ * File descriptors used by the event loop: the epoll instance, a timerfd
+ * for frame ticks, and the eventfd signaled by show_status.  All are -1 
+ * when not open.
+ */
+static int epoll_fd = -1;
+static int tick_fd = -1;
+static int status_fd = -1;
+
+/*
+ * Timers run on the game loop's timer wheel (see wheel.h), which advances
+ * once per frame tick: one erases the status message when its time is up,
+ * and the other updates the elapsed time shown on the Tux controller once
+ * a second.
+ */
+static wheel_timer_t msg_timer = WHEEL_TIMER_INIT (status_expired, NULL);
+static wheel_timer_t clock_timer = WHEEL_TIMER_INIT (tux_clock, NULL);
+static int32_t clock_sec = 0;    /* seconds shown on the Tux controller */
+static uint64_t clock_start;     /* game time at which clock_sec was 0  */
+
+
+/* 
+ * arm_timer
+ *   DESCRIPTION: Start (or restart) a timerfd relative to the current time.
+ *   INPUTS: tfd -- the timerfd
+ *           first_ns -- nanoseconds until the first expiration
+ *           period_ns -- nanoseconds between later expirations (0 for 
+ *                        a one-shot timer)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: discards any expirations not yet read
+ */
+static void
+arm_timer (int tfd, int64_t first_ns, int64_t period_ns)
+{
+    struct itimerspec its; /* timer setting */
+
+    its.it_value.tv_sec = first_ns / 1000000000;
+    its.it_value.tv_nsec = first_ns % 1000000000;
+    its.it_interval.tv_sec = period_ns / 1000000000;
+    its.it_interval.tv_nsec = period_ns % 1000000000;
+    (void)timerfd_settime (tfd, 0, &its, NULL);
+}
+
+
+/* 
+ * build_cmd_trie
+ *   DESCRIPTION: Build the trie used to look up typed verbs from the 
+ *                typed command list.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if a verb is not made of letters or
+ *                 the verbs need more than MAX_TRIE_NODES nodes
+ *   SIDE EFFECTS: fills cmd_trie
+ */
+static int32_t
+build_cmd_trie ()
+{
+    int32_t n_nodes; /* trie nodes in use                  */
+    int32_t idx;     /* index over list of typed commands  */
+    int32_t depth;   /* index over letters of verb         */
+    int32_t node;    /* trie node for verb prefix          */
+    int32_t c;       /* letter of verb (0 to 25)           */
+
+    (void)memset (cmd_trie, 0, sizeof (cmd_trie));
+    n_nodes = 1;
+    for (idx = 0; NULL != cmd_list[idx].name; idx++) {
+	node = 0;
+	for (depth = 0; '\0' != cmd_list[idx].name[depth]; depth++) {
+	    c = tolower (cmd_list[idx].name[depth]) - 'a';
+	    if (0 > c || 26 <= c) {
+		return -1;
+	    }
+	    if (0 == cmd_trie[node].child[c]) {
+		if (MAX_TRIE_NODES == n_nodes) {
+		    return -1;
+		}
+		cmd_trie[node].child[c] = n_nodes++;
+	    }
+	    node = cmd_trie[node].child[c];
 
-/******************	THREADS	*************************************
- * We will create 2 threads here. The use is as follows:		*
- * One thread keeps running continuously in the background		*
- * keeping a track of an interrupt generated by keyboard		*
- * The other thread keeps a track of an interrupt generated 	*
- * from the TUX controller.										*
- * These threads basically maintain continuous 					*
- * detection of interrupts so that we can use the TUX 			*
- * and the keyboards together.									*
-****************************************************************/
+	    /* Earlier commands in the list take precedence. */
+	    if (cmd_list[idx].min_len <= depth + 1 && NULL == cmd_trie[node].fn) {
+		cmd_trie[node].fn = cmd_fn[cmd_list[idx].cmd];
+	    }
+	}
+    }
+    return 0;
+}
 
-//static pthread_t keyboard_thread;
-static pthread_t timer_thread;
 
 /* 
- * cancel_status_thread
- *   DESCRIPTION: Terminates the status message helper thread.  Used as
- *                a cleanup method to ensure proper shutdown.
+ * close_events
+ *   DESCRIPTION: Closes the event loop's file descriptors.  Used as a
+ *                cleanup method to ensure proper shutdown.
  *   INPUTS: none (ignored)
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
 static void
-cancel_status_thread (void* ignore)
+close_events (void* ignore)
 {
-    (void)pthread_cancel (status_thread_id);
+    int* fds[] = {&status_fd, &tick_fd, &epoll_fd};
+    int i; /* index over file descriptors */
+
+    for (i = 0; sizeof (fds) / sizeof (fds[0]) > i; i++) {
+	if (0 <= *fds[i]) {
+	    (void)close (*fds[i]);
+	    *fds[i] = -1;
+	}
+    }
+}
+
+
+/* 
+ * cmd_drop
+ *   DESCRIPTION: Handler for the drop command: drops an object, then
+ *                slows motion if the player no longer has an accelerator.
+ *   INPUTS: rptr -- pointer to player's current room
+ *           arg -- name of the object to drop
+ *   OUTPUTS: none
+ *   RETURN VALUE: result of typed_cmd_drop
+ *   SIDE EFFECTS: see typed_cmd_drop; may change motion speed
+ */
+static tc_action_t
+cmd_drop (room_t** rptr, const char* arg)
+{
+    tc_action_t result = typed_cmd_drop (rptr, arg);
+
+    if (!player_has_board ()) {
+	game_info.x_speed = MOTION_SPEED;
+    }
+    if (!player_has_jetpack ()) {
+	game_info.y_speed = MOTION_SPEED;
+    }
+    return result;
+}
+
+
+/* 
+ * cmd_get
+ *   DESCRIPTION: Handler for the get command: picks up an object, then
+ *                speeds up motion if the player has an accelerator.
+ *   INPUTS: rptr -- pointer to player's current room
+ *           arg -- name of the object to get
+ *   OUTPUTS: none
+ *   RETURN VALUE: result of typed_cmd_get
+ *   SIDE EFFECTS: see typed_cmd_get; may change motion speed
+ */
+static tc_action_t
+cmd_get (room_t** rptr, const char* arg)
+{
+    tc_action_t result = typed_cmd_get (rptr, arg);
+
+    if (player_has_board ()) {
+	game_info.x_speed = MOTION_SPEED * 3;
+    }
+    if (player_has_jetpack ()) {
+	game_info.y_speed = MOTION_SPEED * 3;
+    }
+    return result;
+}
+
+
+/* 
+ * do_command
+ *   DESCRIPTION: Carry out a command from the input device (or a replay
+ *                script).
+ *   INPUTS: cmd -- the command
+ *           typed -- the typed command (used for CMD_TYPED)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the player quits, 0 otherwise
+ *   SIDE EFFECTS: may move the view window, the player, and/or objects;
+ *                 sets enter_room if the player's room changes
+ */
+static int32_t
+do_command (cmd_t cmd, const char* typed)
+{
+    switch (cmd) {
+	case CMD_UP:    move_photo_down ();  break;
+	case CMD_RIGHT: move_photo_left ();  break;
+	case CMD_DOWN:  move_photo_up ();    break;
+	case CMD_LEFT:  move_photo_right (); break;
+	case CMD_MOVE_LEFT:   
+	    enter_room = (TC_CHANGE_ROOM == 
+			  try_to_move_left (&game_info.where));
+	    break;
+	case CMD_ENTER:
+	    enter_room = (TC_CHANGE_ROOM ==
+			  try_to_enter (&game_info.where));
+	    break;
+	case CMD_MOVE_RIGHT:
+	    enter_room = (TC_CHANGE_ROOM == 
+			  try_to_move_right (&game_info.where));
+	    break;
+	case CMD_TYPED:
+	    if (handle_typing (typed)) {
+		enter_room = 1;
+	    }
+	    break;
+	case CMD_QUIT: return 1;
+	default: break;
+    }
+    return 0;
+}
+
+
+/* 
+ * dump_frame_times
+ *   DESCRIPTION: Prints the per-phase frame timing histograms.  Used as
+ *                a cleanup method so that timing is reported however the
+ *                game ends.
+ *   INPUTS: none (ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints to stderr
+ */
+static void
+dump_frame_times (void* ignore)
+{
+    prof_dump (stderr);
+}
+
+
+/* 
+ * game_now
+ *   DESCRIPTION: Read the game clock: script time when replaying, or the
+ *                monotonic clock otherwise.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: game time in nanoseconds
+ *   SIDE EFFECTS: none
+ */
+static uint64_t
+game_now ()
+{
+    return (replaying ? replay_ns : prof_now ());
 }
 
 
 /* 
  * game_loop
- *   DESCRIPTION: Main event loop for the adventure game.
+ *   DESCRIPTION: Main event loop for the adventure game.  Sleeps in epoll
+ *                until keystrokes or Tux controller data arrive, a frame
+ *                tick passes, or a status message is posted, then handles
+ *                the event at once and sends the render thread a new 
+ *                frame if anything changed.  Tux button changes arrive
+ *                as queued events on the controller's fd, so a press is
+ *                handled as soon as it is read.  Ticks advance the timer
+ *                wheel (running any timed events due) and define the 
+ *                pace of held buttons: while a single direction button 
+ *                is held and no other input is waiting, each tick 
+ *                repeats its move.
+ *                Time spent in each phase is charged to the frame 
+ *                profiler (see prof.h).
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: GAME_QUIT if the player quits, or GAME_WON if they have won
@@ -217,178 +544,267 @@ game_loop ()
      * Variables used to carry information between event loop ticks; see
      * initialization below for explanations of purpose.
      */
-    struct timeval start_time, tick_time; 	
-
-
-    struct timeval cur_time; 		/* current time (during tick)      */
+    struct timespec tick_time;
+
+
+    struct timespec cur_time; 		/* current time (during tick)      */
+    struct epoll_event ev[NUM_EVENT_SOURCES]; /* events ready          */
+    int n_ev;                /* number of events ready          */
+    int i;                   /* index over events ready         */
+    uint64_t count;          /* timer expirations/eventfd count */
+    int32_t tick;            /* a frame tick has passed         */
+    uint32_t input;          /* input sources with data waiting */
+    int32_t stdin_always;    /* stdin can't be watched: read it */
+    			     /*   on every pass (e.g., a file)  */
+    int32_t need_draw;       /* screen must be updated          */
     cmd_t cmd;               /* command issued by input control */		
-    //int32_t enter_room;
+    uint64_t loop_start;     /* time at which this pass began   */
+    uint64_t t0, t1;         /* timestamps for phase profiling  */
+    uint64_t wait_ns;        /* time spent waiting for events   */
+    game_condition_t game;   /* outcome of playing              */
+
+    /* 
+     * Start the frame tick timer.  tick_time is the time at which the
+     * next tick should occur, used to measure wake-up lateness; ticks
+     * are timed with the monotonic clock, which does not jump when the
+     * system time is set.
+     */
+    (void)clock_gettime (CLOCK_MONOTONIC, &tick_time);
+    if ((tick_time.tv_nsec += TICK_USEC * 1000) >= 1000000000) {
+	tick_time.tv_sec++;
+	tick_time.tv_nsec -= 1000000000;
+    }
+    arm_timer (tick_fd, TICK_USEC * 1000LL, TICK_USEC * 1000LL);
 
-    /* Record the starting time--assume success. */
-    (void)gettimeofday (&start_time, NULL);
+    /* 
+     * Watch for input.  The Tux line discipline reports data ready when
+     * it has queued button changes, so neither source is read on a tick
+     * without input (though a held direction still repeats each tick).
+     * epoll cannot watch a regular file, so when stdin is redirected 
+     * from one, stdin is instead read on every pass (at least once per
+     * tick), as it was before the event loop.
+     */
+    stdin_always = !watch_fd (fileno (stdin), EV_STDIN);
+    if (0 <= tux_fd ()) {
+	(void)watch_fd (tux_fd (), EV_TUX);
+    }
 
-    /* Calculate the time at which the first event loop tick should occur. */
-    tick_time = start_time;													
-    if ((tick_time.tv_usec += TICK_USEC) > 1000000) {						
-	tick_time.tv_sec++;															
-	tick_time.tv_usec -= 1000000;												
+    /* Start (or resume) the clock on the Tux controller. */
+    if (0 <= tux_fd ()) {
+	clock_start = game_now () - clock_sec * 1000000000ULL;
+	tux_clock (NULL);
     }
-    pthread_create (&timer_thread, NULL, display_time_on_tux, &(start_time.tv_sec));
+
     /* The player has just entered the first room. */
     enter_room = 1;
+    need_draw = 1;
+    msg_timer.arg = &need_draw;
 
     /* The main event loop. */
     while (1) {
-	/* 
-	 * Update the screen, preparing the VGA palette and photo-drawing
-	 * routines and drawing a new room photo first if the player has
-	 * entered a new room, then showing the screen (and status bar,
-	 * once you have it working).
-	 */
-	if (enter_room) {
-	    /* Reset the view window to (0,0). */
-	    game_info.map_x = game_info.map_y = 0;
-	    set_view_window (game_info.map_x, game_info.map_y);
-
-	    /* Discard any partially-typed command. */
-	    reset_typed_command ();
-	    
-	    /* Adjust colors and photo drawing for the current room photo. */
-	    prep_room (game_info.where);
-
-	    /* Draw the room (calls show. */
-	    redraw_room ();
-
-	    /* Only draw once on entry. */
-	    enter_room = 0;
-	}
-
-	show_screen ();
+	loop_start = prof_now ();
 
-	/**************************		THIS HELPER FUNCTION WRITTEN BY ME 		***************************************/
-	/****************************************************************************************
-	*	This function fills the buffer with the ascii of the string which is passes to us.	*	 	
-	* 	It then calls show status bar which draws or prints the characters on the screen.	*
-	*	We use world.c to get the string and an offset while calling text_to_graphics.		*
-	*	We keep the function inside the locks for an interrupt might disturb the buffer.  	*
-	****************************************************************************************/
-
-	pthread_mutex_lock (&msg_lock);									//start the lock here to stop most interrupts 
-
-	unsigned char buffer[STATUS_BAR_PIXEL_OFFSET];					//create a buffer. Size is given by 320(width) * 18(height)
-	
-	
-//	text_to_graphics (room_name (game_info.where), buffer, 0);		//use this buffer to write font data
-//	text_to_graphics (get_typed_command(), buffer, 1);				//here the typing command is getting stored		
-
-	const char* written_on_screen = get_typed_command();			//we call the messages to pass into text_to_graphics
-    const char* present_room = room_name(game_info.where);			//we call the messages to pass into text_to_graphics
-	text_to_graphics(buffer, written_on_screen, present_room, status_msg);	
-
-
-	print_status_bar (buffer);											
-	pthread_mutex_unlock (&msg_lock);								//release the lock				
-	///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	/* Update the screen if anything has changed. */
+	if (need_draw) {
+	    update_screen ();
+	    need_draw = 0;
+	}
 
-	/*
-	 * Wait for tick.  The tick defines the basic timing of our
-	 * event loop, and is the minimum amount of time between events.
-	 */
-	do {
-	    if (gettimeofday (&cur_time, NULL) != 0) {
+	/* Wait for events. */
+	t0 = prof_now ();
+	while (0 > (n_ev = epoll_wait (epoll_fd, ev, NUM_EVENT_SOURCES, -1))) {
+	    if (EINTR != errno) {
 		/* Panic!  (should never happen) */
+		stop_renderer ();
 		clear_mode_X ();
 		shutdown_input ();
-		perror ("gettimeofday");
+		perror ("epoll_wait");
 		exit (3);
 	    }
-	} while (!time_is_after (&cur_time, &tick_time));
-
-	/*
-	 * Advance the tick time.  If we missed one or more ticks completely, 
-	 * i.e., if the current time is already after the time for the next 
-	 * tick, just skip the extra ticks and advance the clock to the one
-	 * that we haven't missed.
-	 */
-	do {
-	    if ((tick_time.tv_usec += TICK_USEC) > 1000000) {
-		tick_time.tv_sec++;
-		tick_time.tv_usec -= 1000000;
+	}
+	wait_ns = prof_now () - t0;
+	prof_add (PHASE_WAIT, wait_ns);
+
+	tick = 0;
+	input = (stdin_always ? INPUT_KEYBOARD : 0);
+	for (i = 0; n_ev > i; i++) {
+	    switch (ev[i].data.u32) {
+		case EV_TICK:
+		    if (sizeof (count) != read (tick_fd, &count, 
+		    				 sizeof (count))) {
+			break;
+		    }
+		    tick = 1;
+
+		    /* Record how late we woke up. */
+		    (void)clock_gettime (CLOCK_MONOTONIC, &cur_time);
+		    prof_add (PHASE_WAKE_LATE, 
+			      (cur_time.tv_sec - tick_time.tv_sec) * 
+			      1000000000LL +
+			      (cur_time.tv_nsec - tick_time.tv_nsec));
+
+		    /*
+		     * Run timed events, then advance the tick time.  If we
+		     * missed one or more ticks completely, the timer counts
+		     * them: timed events still run (late), but we skip the
+		     * extra ticks otherwise.
+		     */
+		    wheel_advance (count);
+		    flush_tux_leds ();
+		    while (0 < count--) {
+			if ((tick_time.tv_nsec += TICK_USEC * 1000) >= 
+			    1000000000) {
+			    tick_time.tv_sec++;
+			    tick_time.tv_nsec -= 1000000000;
+			}
+		    }
+		    break;
+
+		case EV_STDIN:
+		    if (0 != (ev[i].events & (EPOLLHUP | EPOLLERR))) {
+			/* Input closed: stop watching it. */
+			(void)epoll_ctl (epoll_fd, EPOLL_CTL_DEL, 
+					 fileno (stdin), NULL);
+		    }
+		    input |= INPUT_KEYBOARD;
+		    break;
+
+		case EV_TUX:
+		    input |= INPUT_TUX;
+		    break;
+
+		case EV_STATUS_POSTED:
+		    /* (Re)start the timer for erasing the message. */
+		    (void)read (status_fd, &count, sizeof (count));
+		    wheel_schedule (&msg_timer, (STATUS_MSG_NSEC / 1000 +
+		    				 TICK_USEC - 1) / TICK_USEC);
+		    need_draw = 1;
+		    break;
 	    }
-	} while (time_is_after (&cur_time, &tick_time));
-
-	/*
-	 * Handle asynchronous events.  These events use real time rather
-	 * than tick counts for timing, although the real time is rounded
-	 * off to the nearest tick by definition.
-	 */
-	/* (none right now...) */													
+	}
 
 	/* 
 	 * Handle synchronous events--in this case, only player commands. 
 	 * Note that typed commands that move objects may cause the room
 	 * to be redrawn.
 	 */
-	
-	pthread_mutex_lock(&msg_lock);
-
-	cmd = get_command ();
-
-	pthread_mutex_unlock(&msg_lock);
+	t0 = t1 = prof_now ();
+	if (tick || input) {
+	    cmd = get_command (input);
 
-	switch (cmd) {
-	    case CMD_UP:    move_photo_down ();  break;
-	    case CMD_RIGHT: move_photo_left ();  break;
-	    case CMD_DOWN:  move_photo_up ();    break;
-	    case CMD_LEFT:  move_photo_right (); break;
-	    case CMD_MOVE_LEFT:   
-		enter_room = (TC_CHANGE_ROOM == 
-			      try_to_move_left (&game_info.where));
-		break;
-	    case CMD_ENTER:
-		enter_room = (TC_CHANGE_ROOM ==
-			      try_to_enter (&game_info.where));
-		break;
-	    case CMD_MOVE_RIGHT:
-		enter_room = (TC_CHANGE_ROOM == 
-			      try_to_move_right (&game_info.where));
-		break;
-	    case CMD_TYPED:
-		if (handle_typing ()) {
-		    enter_room = 1;
+	    /* 
+	     * Keystrokes (including any queued behind a command by an 
+	     * earlier read) may have changed the typed command shown.
+	     * Only input that changes the screen starts a latency 
+	     * measurement; otherwise its arrival time would be charged to
+	     * some later, unrelated frame.
+	     */
+	    if (typed_changed () || CMD_NONE != cmd) {
+		need_draw = 1;
+		if (0 == input_ns) {
+		    input_ns = get_input_time ();
 		}
+	    } else {
+		input_ns = 0;
+	    }
+
+	    if (do_command (cmd, get_typed_command ())) {
+		game = GAME_QUIT;
 		break;
-	    case CMD_QUIT: return GAME_QUIT;
-	    default: break;
+	    }
+	    t1 = prof_now ();
+	    prof_add (PHASE_COMMAND, t1 - t0);
 	}
 
+	/* Close the pass: everything but the wait counts against the budget. */
+	prof_add (PHASE_BUSY, t1 - loop_start - wait_ns);
+	prof_end_frame ();
+
 	/* If player wins the game, their room becomes NULL. */
 	if (NULL == game_info.where) {
-	    return GAME_WON;
+	    game = GAME_WON;
+	    break;
 	}
     } /* end of the main event loop */
+
+    /* Stop the timers (msg_timer refers to need_draw). */
+    wheel_cancel (&msg_timer);
+    wheel_cancel (&clock_timer);
+    return game;
+}
+
+
+/* 
+ * status_expired
+ *   DESCRIPTION: Timer callback for the end of a status message's display
+ *                time.  The timer runs on tick boundaries, so it may come
+ *                slightly early; if the message has not yet expired (see 
+ *                read_status), it checks again at the next tick.
+ *   INPUTS: need_draw -- the game loop's flag for updating the screen
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: sets *need_draw, or reschedules msg_timer
+ */
+static void
+status_expired (void* need_draw)
+{
+    char msg[STATUS_MSG_LEN + 1]; /* status message */
+
+    read_status (msg);
+    if ('\0' != msg[0]) {
+	wheel_schedule (&msg_timer, 1);
+	return;
+    }
+    *(int32_t*)need_draw = 1;
+}
+
+
+/* 
+ * tux_clock
+ *   DESCRIPTION: Timer callback that shows the elapsed time on the Tux
+ *                controller, once a second.  The seconds are counted 
+ *                from clock_start rather than from the callbacks, and
+ *                each callback is scheduled for the tick nearest the
+ *                start of the next second, so the clock does not drift
+ *                when ticks are late or missed.  Times are rounded to 
+ *                the nearest tick to absorb wake-up jitter.
+ *   INPUTS: ignore -- ignored
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates the controller's display; reschedules clock_timer
+ */
+static void
+tux_clock (void* ignore)
+{
+    uint64_t elapsed = game_now () - clock_start; /* ns since clock start */
+    uint64_t wait_us;                             /* us to next second    */
+
+    clock_sec = (elapsed + TICK_USEC * 500ULL) / 1000000000ULL;
+    display_time_on_tux (clock_sec);
+    wait_us = ((clock_sec + 1) * 1000000000ULL - elapsed) / 1000;
+    wheel_schedule (&clock_timer, (wait_us + TICK_USEC / 2) / TICK_USEC);
 }
 
 
 /* 
  * handle_typing
  *   DESCRIPTION: Parse and execute a typed command.
- *   INPUTS: none (reads typed command)
+ *   INPUTS: typed -- the typed command
  *   OUTPUTS: none
  *   RETURN VALUE: 1 if the player's room changes, 0 otherwise
- *   SIDE EFFECTS: may move the player, move objects, and/or redraw the screen
+ *   SIDE EFFECTS: may move the player and/or move objects
  */
 static int32_t
-handle_typing ()
+handle_typing (const char* typed)
 {
     const char*      cmd;     /* command verb typed                */
     int32_t          cmd_len; /* length of command verb            */
     const char*      arg;     /* argument given to command verb    */
-    int32_t          idx;     /* loop index over command list      */
+    tc_fn_t          fn;      /* handler for command verb          */
     tc_action_t      result;  /* result of typed command execution */
 
-    /* Read the command and strip leading spaces.  If it's empty, return. */
-    cmd = get_typed_command ();
+    /* Strip leading spaces from the command.  If it's empty, return. */
+    cmd = typed;
     while (' ' == *cmd) { cmd++; }
     if ('\0' == *cmd) { return 0; }
 
@@ -403,92 +819,26 @@ handle_typing ()
     arg = &cmd[cmd_len];
     while (' ' == *arg) { arg++; }
 
-    /* Compare the typed verb with each command in our list. */
-    for (idx = 0; NULL != cmd_list[idx].name; idx++) {
-
-        /* If the typed verb is not long enough, it can't match. */
-	if (cmd_list[idx].min_len > cmd_len) { continue; }
+    /* Look up the typed verb. */
+    if (NULL == (fn = lookup_cmd (cmd, cmd_len))) {
+	show_status ("What are you babbling about?");
+	return 0;
+    }
 
-	/* Compare the prefix of the command with the typed verb. */
-        if (0 != strncasecmp (cmd_list[idx].name, cmd, cmd_len)) { continue; }
+    /* Execute the command found. */
+    result = (*fn) (&game_info.where, arg);
 
-	/* Execute the command found. */
-	switch (cmd_list[idx].cmd) {
-	    case TC_BUY:
-	        result = typed_cmd_buy (&game_info.where, arg);
-		break;
-	    case TC_CHARGE:
-	        result = typed_cmd_charge (&game_info.where, arg);
-		break;
-	    case TC_DO:
-	        result = typed_cmd_do (&game_info.where, arg);
-		break;
-	    case TC_DRINK:
-	        result = typed_cmd_drink (&game_info.where, arg);
-		break;
-	    case TC_DROP:
-	        result = typed_cmd_drop (&game_info.where, arg);
-		if (!player_has_board ()) {
-		    game_info.x_speed = MOTION_SPEED;
-		}
-		if (!player_has_jetpack ()) {
-		    game_info.y_speed = MOTION_SPEED;
-		}
-		break;
-	    case TC_FIX:
-	        result = typed_cmd_fix (&game_info.where, arg);
-		break;
-	    case TC_FLASH:
-	        result = typed_cmd_flash (&game_info.where, arg);
-		break;
-	    case TC_GET:
-	        result = typed_cmd_get (&game_info.where, arg);
-		if (player_has_board ()) {
-		    game_info.x_speed = MOTION_SPEED * 3;
-		}
-		if (player_has_jetpack ()) {
-		    game_info.y_speed = MOTION_SPEED * 3;
-		}
-		break;
-	    case TC_GO:
-	        result = typed_cmd_go (&game_info.where, arg);
-		break;
-	    case TC_INSTALL:
-	        result = typed_cmd_install (&game_info.where, arg);
-		break;
-	    case TC_INVENTORY:
-	        result = typed_cmd_inventory (&game_info.where, arg);
-		break;
-	    case TC_SIGH:
-	        result = typed_cmd_sigh (&game_info.where, arg);
-		break;
-	    case TC_USE:
-	        result = typed_cmd_use (&game_info.where, arg);
-		break;
-	    case TC_WEAR:
-	        result = typed_cmd_wear (&game_info.where, arg);
-		break;
-	    default:
-		show_status ("Bug...!");
-		result = TC_ALLOW_EDIT;
-	        break;
-	}
-
-	/* Handle command result and return. */
-	if (TC_CHANGE_ROOM == result) {
-	    return 1;
-	}
-	if (TC_ALLOW_EDIT != result) {
-	    reset_typed_command ();
-	    if (TC_REDRAW_ROOM == result) {
-	        redraw_room ();
-	    }
-	}
-	return 0;
+    /* Handle command result and return. */
+    if (TC_CHANGE_ROOM == result) {
+	return 1;
+    }
+    /* 
+     * Objects moved by TC_REDRAW_ROOM commands are redrawn by 
+     * update_screen, which sends the room's changes to the renderer.
+     */
+    if (TC_ALLOW_EDIT != result) {
+	reset_typed_command ();
     }
-    
-    /* The command was not recognized. */
-    show_status ("What are you babbling about?");
     return 0;
 }
 
@@ -514,6 +864,33 @@ init_game ()
 }
 
 
+/* 
+ * lookup_cmd
+ *   DESCRIPTION: Find the handler for a typed verb (any case) in the 
+ *                typed command trie.
+ *   INPUTS: verb -- the verb (need not be NUL-terminated)
+ *           len -- length of the verb
+ *   OUTPUTS: none
+ *   RETURN VALUE: the handler, or NULL if the verb matches no command
+ *   SIDE EFFECTS: none
+ */
+static tc_fn_t
+lookup_cmd (const char* verb, int32_t len)
+{
+    int32_t node; /* trie node for verb prefix */
+    int32_t idx;  /* index over letters of verb */
+    int32_t c;    /* letter of verb (0 to 25)   */
+
+    for (node = 0, idx = 0; len > idx; idx++) {
+	c = tolower ((unsigned char)verb[idx]) - 'a';
+	if (0 > c || 26 <= c || 0 == (node = cmd_trie[node].child[c])) {
+	    return NULL;
+	}
+    }
+    return cmd_trie[node].fn;
+}
+
+
 /* 
  * move_photo_down
  *   DESCRIPTION: Move background photo down one or more pixels.  Amount of
@@ -522,13 +899,12 @@ init_game ()
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: shifts view window
+ *   SIDE EFFECTS: shifts view window (drawn by the render thread)
  */
 static void
 move_photo_down ()
 {
     int32_t delta; /* Number of pixels by which to move. */
-    int32_t idx;   /* Index over rows to redraw.         */
 
     /* Calculate the number of pixels by which to move. */
     delta = (game_info.y_speed > game_info.map_y ?
@@ -536,12 +912,7 @@ move_photo_down ()
 
     /* Shift the logical view upward. */
     game_info.map_y -= delta;
-    set_view_window (game_info.map_x, game_info.map_y);
-
-    /* Draw the newly exposed lines. */
-    for (idx = 0; delta > idx; idx++) {
-	(void)draw_horiz_line (idx);
-    }
+    render_scroll (game_info.map_x, game_info.map_y);
 }
 
 
@@ -553,13 +924,12 @@ move_photo_down ()
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: shifts view window
+ *   SIDE EFFECTS: shifts view window (drawn by the render thread)
  */
 static void
 move_photo_left ()
 {
     int32_t delta; /* Number of pixels by which to move. */
-    int32_t idx;   /* Index over columns to redraw.      */
 
     /* Calculate the number of pixels by which to move. */
     delta = room_photo_width (game_info.where) - SCROLL_X_DIM -
@@ -568,12 +938,7 @@ move_photo_left ()
 
     /* Shift the logical view to the right. */
     game_info.map_x += delta;
-    set_view_window (game_info.map_x, game_info.map_y);
-
-    /* Draw the newly exposed lines. */
-    for (idx = 1; delta >= idx; idx++) {
-	(void)draw_vert_line (SCROLL_X_DIM - idx);
-    }
+    render_scroll (game_info.map_x, game_info.map_y);
 }
 
 
@@ -585,13 +950,12 @@ move_photo_left ()
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: shifts view window
+ *   SIDE EFFECTS: shifts view window (drawn by the render thread)
  */
 static void
 move_photo_right ()
 {
     int32_t delta; /* Number of pixels by which to move. */
-    int32_t idx;   /* Index over columns to redraw.      */
 
     /* Calculate the number of pixels by which to move. */
     delta = (game_info.x_speed > game_info.map_x ?
@@ -599,12 +963,7 @@ move_photo_right ()
 
     /* Shift the logical view to the left. */
     game_info.map_x -= delta;
-    set_view_window (game_info.map_x, game_info.map_y);
-
-    /* Draw the newly exposed lines. */
-    for (idx = 0; delta > idx; idx++) {
-	(void)draw_vert_line (idx);
-    }
+    render_scroll (game_info.map_x, game_info.map_y);
 }
 
 
@@ -616,13 +975,12 @@ move_photo_right ()
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: shifts view window
+ *   SIDE EFFECTS: shifts view window (drawn by the render thread)
  */
 static void
 move_photo_up ()
 {
     int32_t delta; /* Number of pixels by which to move. */
-    int32_t idx;   /* Index over rows to redraw.         */
 
     /* Calculate the number of pixels by which to move. */
     delta = room_photo_height (game_info.where) - SCROLL_Y_DIM - 
@@ -631,124 +989,309 @@ move_photo_up ()
 
     /* Shift the logical view upward. */
     game_info.map_y += delta;
-    set_view_window (game_info.map_x, game_info.map_y);
+    render_scroll (game_info.map_x, game_info.map_y);
+}
+
 
-    /* Draw the newly exposed lines. */
-    for (idx = 1; delta >= idx; idx++) {
-	(void)draw_horiz_line (SCROLL_Y_DIM - idx);
+/* 
+ * open_events
+ *   DESCRIPTION: Create the event loop's epoll instance, frame tick 
+ *                timer (not yet started), and the eventfd used by 
+ *                show_status, and watch all but the first.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure (with nothing left open)
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static int32_t
+open_events ()
+{
+    if (0 > (epoll_fd = epoll_create1 (EPOLL_CLOEXEC)) ||
+	0 > (tick_fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC)) ||
+	0 > (status_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK))) {
+	perror ("create event loop");
+	close_events (NULL);
+	return -1;
     }
+    (void)watch_fd (tick_fd, EV_TICK);
+    (void)watch_fd (status_fd, EV_STATUS_POSTED);
+    return 0;
 }
 
 
 /* 
- * redraw_room
- *   DESCRIPTION: Draw all lines on the screen.
+ * read_status
+ *   DESCRIPTION: Copy the status message without locking (see the notes
+ *                on status_msg), or an empty string if its time is up.
  *   INPUTS: none
- *   OUTPUTS: none
+ *   OUTPUTS: msg -- the message
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Draws the entire screen (but not the status bar).
+ *   SIDE EFFECTS: none
  */
 static void
-redraw_room ()
+read_status (char msg[STATUS_MSG_LEN + 1])
 {
-    int32_t i; /* index over rows */
-
-    /* Draw all lines in the scroll region. */
-    for (i = 0; i < SCROLL_Y_DIM; i++) {
-	(void)draw_horiz_line (i);
+    uint32_t seq;     /* msg_seq before copying */
+    uint64_t expires; /* expiry time of message */
+
+    do {
+	seq = __atomic_load_n (&msg_seq, __ATOMIC_ACQUIRE);
+	(void)memcpy (msg, status_msg, STATUS_MSG_LEN + 1);
+	expires = msg_expires;
+	__atomic_thread_fence (__ATOMIC_ACQUIRE);
+    } while (0 != (seq & 1) || 
+    	     seq != __atomic_load_n (&msg_seq, __ATOMIC_RELAXED));
+
+    msg[STATUS_MSG_LEN] = '\0';
+    if (expires <= game_now ()) {
+	msg[0] = '\0';
     }
 }
 
 
 /* 
- * status_thread
- *   DESCRIPTION: Function executed by status message helper thread.
- *                Waits for a message to be displayed, then shows the
- *                message for 1.5 seconds before deleting it.  If a
- *                new message has appeared in the meantime, restarts the
- *                clock and tries again.
- *   INPUTS: none (ignored)
+ * replay
+ *   DESCRIPTION: Play the game from a script instead of input devices, as
+ *                fast as possible.  Each script line is "ms command [text]":
+ *                at ms milliseconds of game time, issue the command, named
+ *                as in replay_cmd_name; for "type", text is executed as a
+ *                typed command.  Lines that are blank or start with '#' 
+ *                are ignored.  As in play, a frame is drawn on entering
+ *                the first room and at every tick of game time (after the
+ *                commands due before it) up to the last command, and one
+ *                more after the last command.  Returns only after the 
+ *                render thread has drawn every frame.
+ *   INPUTS: fname -- file name of the script
  *   OUTPUTS: none
- *   RETURN VALUE: NULL
- *   SIDE EFFECTS: Changes the status message to an empty string.
+ *   RETURN VALUE: GAME_WON if the player wins, GAME_QUIT otherwise
+ *   SIDE EFFECTS: drives the display; stops the render thread; panics if
+ *                 the script cannot be read or has a bad line
  */
-static void*
-status_thread (void* ignore)
+static game_condition_t
+replay (const char* fname)
 {
-    struct timespec ts; /* absolute wake-up time */
-
-    while (1) {
+    FILE*       f;              /* the script                      */
+    char        line[200];      /* line of script                  */
+    char        verb[20];       /* command name                    */
+    const char* text;           /* text typed, for "type"          */
+    long        ms;             /* time of command in milliseconds */
+    int         pos;            /* offset of text in line          */
+    int32_t     line_num = 0;   /* line number in script           */
+    int32_t     cmd;            /* command (a cmd_t)               */
+    uint64_t    tick = 0;       /* ticks of game time played       */
+    uint64_t    pass_start;     /* time at which this frame began  */
+    uint64_t    t0, t1;         /* timestamps for phase profiling  */
+    game_condition_t game = GAME_QUIT; /* outcome of playing       */
+
+    if (NULL == (f = fopen (fname, "r"))) {
+	perror (fname);
+	PANIC ("cannot read replay script");
+    }
 
-	/* 
-	 * Wait for a message to appear.  Note that we must check the
-	 * condition after acquiring the lock, and that pthread_cond_wait
-	 * yields the lock, then reacquires the lock before returning.
-	 */
-	(void)pthread_mutex_lock (&msg_lock);
-	while ('\0' == status_msg[0]) {
-	    pthread_cond_wait (&msg_cv, &msg_lock);
+    /* The player has just entered the first room: draw it. */
+    replaying = 1;
+    enter_room = 1;
+    pass_start = prof_now ();
+    update_screen ();
+
+    while (NULL != fgets (line, sizeof (line), f)) {
+	line_num++;
+	line[strcspn (line, "\r\n")] = '\0';
+	text = &line[strspn (line, " \t")];
+	if ('\0' == *text || '#' == *text) {
+	    continue;
 	}
-
-	/* 
-	 * A message is present: if we stop before the timeout
-	 * passes, assume that a new one has been posted; if the
-	 * timeout passes, clear the message and wait for a new one.
-	 */
-	do {
-	    /* Get the current time. */
-	    clock_gettime (CLOCK_REALTIME, &ts);
-	    
-	    /* Add 1.5 seconds to it. */
-	    if (500000000 <= ts.tv_nsec) {
-		ts.tv_sec += 2;
-		ts.tv_nsec -= 500000000;
-	    } else {
-		ts.tv_sec += 1;
-		ts.tv_nsec += 500000000;
+	cmd = NUM_COMMANDS;
+	if (2 == sscanf (line, "%ld %19s%n", &ms, verb, &pos) && 0 <= ms) {
+	    for (cmd = 0; NUM_COMMANDS > cmd; cmd++) {
+		if (0 == strcmp (verb, replay_cmd_name[cmd])) {
+		    break;
+		}
 	    }
+	}
+	if (NUM_COMMANDS == cmd) {
+	    fprintf (stderr, "%s:%d: bad replay command\n", fname, line_num);
+	    PANIC ("bad replay script");
+	}
 
-	    /* 
-	     * And go to sleep.  If we wake up due to anything but a
-	     * timeout, we assume (possibly incorrectly) that a new
-	     * message has appeared and try to wait 1.5 seconds again.
-	     */
-	} while (ETIMEDOUT != 
-		 pthread_cond_timedwait (&msg_cv, &msg_lock, &ts));
+	/* Finish a frame for each tick before the command is due. */
+	while (tick < (uint64_t)ms * 1000 / TICK_USEC) {
+	    t1 = prof_now ();
+	    prof_add (PHASE_BUSY, t1 - pass_start);
+	    prof_end_frame ();
+	    pass_start = t1;
+	    replay_ns = ++tick * TICK_USEC * 1000ULL;
+	    wheel_advance (1);
+	    update_screen ();
+	}
 
-	/* 
-	 * Clear the message, then release the lock (remember that 
-	 * pthread_cond_timedwait reacquires the lock before returning).
-	 */
-	status_msg[0] = '\0';
-	(void)pthread_mutex_unlock (&msg_lock);
+	/* Issue the command (it arrives now, for latency). */
+	for (text = &line[pos]; ' ' == *text; text++);
+	t0 = prof_now ();
+	if (0 == input_ns) {
+	    input_ns = t0;
+	}
+	if (do_command (cmd, text)) {
+	    break;
+	}
+	prof_add (PHASE_COMMAND, prof_now () - t0);
+	if (NULL == game_info.where) {
+	    game = GAME_WON;
+	    break;
+	}
     }
+    (void)fclose (f);
 
-    /* This code never executes--the thread should always be cancelled. */
-    return NULL;
+    /* Draw the final frame and wait for the render thread to finish. */
+    if (NULL != game_info.where) {
+	update_screen ();
+	prof_add (PHASE_BUSY, prof_now () - pass_start);
+	prof_end_frame ();
+    }
+    stop_renderer ();
+    return game;
 }
 
 
 /* 
- * time_is_after 
- *   DESCRIPTION: Check whether one time is at or after a second time.
- *   INPUTS: t1 -- the first time
- *           t2 -- the second time
+ * run_batch
+ *   DESCRIPTION: Execute a script of typed commands, one per line, 
+ *                without the display or input devices, and report the 
+ *                command rate.  Stops early if the player wins.
+ *   INPUTS: fname -- file name of the script
+ *           reps -- number of times to run the script
  *   OUTPUTS: none
- *   RETURN VALUE: 1 if t1 >= t2
- *                 0 if t1 < t2
- *   SIDE EFFECTS: none
+ *   RETURN VALUE: 0 on success, -1 if the script cannot be read
+ *   SIDE EFFECTS: plays the game; prints to stdout
  */
 static int
-time_is_after (struct timeval* t1, struct timeval* t2)
+run_batch (const char* fname, int32_t reps)
 {
-    if (t1->tv_sec == t2->tv_sec)
-        return (t1->tv_usec >= t2->tv_usec);
-    if (t1->tv_sec > t2->tv_sec)
-        return 1;
+    FILE*    f;           /* the script                         */
+    char     line[200];   /* line of script                     */
+    char**   cmds = NULL; /* commands in script                 */
+    char**   grow;        /* cmds, after growing                */
+    int32_t  n_cmds = 0;  /* number of commands                 */
+    int32_t  n_done = 0;  /* number of commands executed        */
+    int32_t  rep;         /* index over repetitions             */
+    int32_t  idx;         /* index over commands                */
+    uint64_t t0, ns;      /* time spent executing commands      */
+
+    /* Read the whole script first so that I/O is not timed. */
+    if (NULL == (f = fopen (fname, "r"))) {
+	perror (fname);
+	return -1;
+    }
+    while (NULL != fgets (line, sizeof (line), f)) {
+	line[strcspn (line, "\r\n")] = '\0';
+	if (NULL == (grow = realloc (cmds, (n_cmds + 1) * sizeof (*cmds))) ||
+	    NULL == (grow[n_cmds] = strdup (line))) {
+	    PANIC ("out of memory");
+	}
+	cmds = grow;
+	n_cmds++;
+    }
+    (void)fclose (f);
+
+    t0 = prof_now ();
+    for (rep = 0; reps > rep && NULL != game_info.where; rep++) {
+	for (idx = 0; n_cmds > idx && NULL != game_info.where; idx++) {
+	    (void)handle_typing (cmds[idx]);
+	    n_done++;
+	}
+    }
+    ns = prof_now () - t0;
+
+    printf ("%d commands in %.3f ms (%.0f commands/s)%s\n", n_done, ns / 1e6,
+	    (0 < ns ? n_done * 1e9 / ns : 0), 
+	    (NULL == game_info.where ? "; game won" : ""));
+    for (idx = 0; n_cmds > idx; idx++) {
+	free (cmds[idx]);
+    }
+    free (cmds);
     return 0;
 }
 
 
+/* 
+ * update_screen
+ *   DESCRIPTION: Send the render thread the commands for a new frame:
+ *                a new room photo if the player has entered a new room, 
+ *                or else any changes to the current room, then the 
+ *                status bar, then a request to show the screen.  The 
+ *                render thread does the drawing later, so nothing here
+ *                waits on video memory.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: queues frame commands; clears enter_room and input_ns
+ */
+static void
+update_screen ()
+{
+    room_view_t view;              /* copy of room for render thread */
+    rect_t dirty[MAX_DIRTY_RECTS]; /* changed regions of room photo  */
+    int32_t n_dirty;               /* number of changed regions      */
+    char msg[STATUS_MSG_LEN + 1];  /* copy of status message         */
+
+    if (enter_room) {
+	/* Reset the view window to (0,0). */
+	game_info.map_x = game_info.map_y = 0;
+
+	/* Discard any partially-typed command. */
+	reset_typed_command ();
+	
+	/* Draw the room.  This covers any recorded changes. */
+	(void)room_take_dirty (game_info.where, dirty);
+	room_get_view (game_info.where, &view);
+	render_enter_room (&view, game_info.map_x, game_info.map_y);
+
+	/* Only draw once on entry. */
+	enter_room = 0;
+    } else if (0 != (n_dirty = room_take_dirty (game_info.where, dirty))) {
+	/* Redraw objects moved by typed commands. */
+	room_get_view (game_info.where, &view);
+	render_objects (&view, dirty, n_dirty);
+    }
+
+    read_status (msg);
+    render_status (get_typed_command (), room_name (game_info.where), msg);
+
+    render_show (input_ns);
+    input_ns = 0;
+}
+
+
+/* 
+ * watch_fd
+ *   DESCRIPTION: Add a file descriptor to the event loop's epoll set,
+ *                waiting for it to become readable.
+ *   INPUTS: fd -- the file descriptor
+ *           src -- the event source reported when fd is readable
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if fd is watched, or 0 if fd does not support epoll
+ *                 (e.g., a regular file), in which case it is always 
+ *                 ready and the caller must read it without waiting
+ *   SIDE EFFECTS: panics on any other failure
+ */
+static int32_t
+watch_fd (int fd, event_source_t src)
+{
+    struct epoll_event ev; /* event description */
+
+    (void)memset (&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = src;
+    if (0 != epoll_ctl (epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+	if (EPERM == errno) {
+	    return 0;
+	}
+	PANIC ("cannot watch file descriptor");
+    }
+    return 1;
+}
+
+
 /* 
  * show_status (interface function; declared in world.h)
  *   DESCRIPTION: Show a specific status message of up to STATUS_MSG_LEN
@@ -761,69 +1304,159 @@ time_is_after (struct timeval* t1, struct timeval* t2)
 void
 show_status (const char* s)
 {
-    /* msg_lock critical section starts here. */
-    (void)pthread_mutex_lock (&msg_lock);
-
-    /* Copy the new message under the protection of msg_lock. */
+    static const uint64_t one = 1; /* eventfd increment */
+    uint32_t seq;                  /* msg_seq before writing */
+
+    /* Claim the sequence lock by making msg_seq odd. */
+    do {
+	seq = __atomic_load_n (&msg_seq, __ATOMIC_RELAXED);
+    } while (0 != (seq & 1) ||
+	     !__atomic_compare_exchange_n (&msg_seq, &seq, seq + 1, 0,
+					   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+
+    /* Copy the new message and set its expiry time. */
     strncpy (status_msg, s, STATUS_MSG_LEN);
     status_msg[STATUS_MSG_LEN] = '\0';
+    msg_expires = game_now () + STATUS_MSG_NSEC;
 
-    /* 
-     * Wake up the status message helper thread.  Note that we still hold
-     * the msg_lock, so the thread can't wake up until we release it.
-     */
-    (void)pthread_cond_signal (&msg_cv);
+    /* Publish the message by making msg_seq even again. */
+    __atomic_store_n (&msg_seq, seq + 2, __ATOMIC_RELEASE);
 
-    /* msg_lock critical section ends here. */
-    (void)pthread_mutex_unlock (&msg_lock);
+    /* Wake up the event loop to show the message and time it. */
+    (void)write (status_fd, &one, sizeof (one));
 }
 
 
 /* 
  * main
- *   DESCRIPTION: Play the adventure game.
- *   INPUTS: none (command line arguments are ignored)
+ *   DESCRIPTION: Play the adventure game.  Given "-r script", instead
+ *                replays the script (see replay) with a fixed random seed
+ *                and reports the frame rate.  Given "-b script [reps]", 
+ *                instead executes the typed commands in the script 
+ *                (reps times) without display or input, to measure 
+ *                command throughput.
+ *   INPUTS: argc, argv -- command line arguments
  *   OUTPUTS: none
- *   RETURN VALUE: 0 on success, 3 in panic situations
+ *   RETURN VALUE: 0 on success, 1 on bad arguments, 3 in panic situations
  */
 int
-main ()
+main (int argc, char* argv[])
 {
     game_condition_t game;  /* outcome of playing */
+    present_stats_t  stats; /* frame presentation counters */
+    tux_led_stats_t  leds;  /* Tux LED update counters     */
+    unsigned long    lost;  /* Tux button changes lost     */
+    prerender_stats_t pre;  /* prerendered line counters   */
+    struct timespec  run_start, run_end; /* wall clock time of play */
+    struct rusage    usage; /* CPU time used               */
+    long             minflt, majflt; /* page faults while building world */
+    const arena_t*   mem;   /* world memory counters       */
+    int32_t          ret;   /* batch mode return value     */
+    double           run_sec, cpu_sec;
+    const char*      script = NULL; /* replay script, if any */
+#if defined(REPLAY_PROGRAM)
+    uint64_t         frame_hash = 0; /* hash of last frame shown */
+#endif
 
-    /* Randomize for more fun (remove for deterministic layout). */
-    srand (time (NULL));
+    /* Check the command line. */
+    if (3 == argc && 0 == strcmp (argv[1], "-r")) {
+	script = argv[2];
+    } else if (!(CAN_PLAY && 1 == argc) &&
+	       !((3 == argc || 4 == argc) && 0 == strcmp (argv[1], "-b"))) {
+	fprintf (stderr, "usage: %s %s\n", argv[0], 
+		 (CAN_PLAY ? "[-r script | -b script [reps]]" :
+			     "-r script | -b script [reps]"));
+	return 1;
+    }
+
+    /* 
+     * Randomize for more fun, but place objects the same way in every
+     * replay.
+     */
+    srand (NULL != script ? REPLAY_SEED : time (NULL));
 
     /* Provide some protection against fatal errors. */
     clean_on_signals ();
 
+    /* Count the page faults taken while reading all of the images. */
+    minflt = majflt = 0;
+    if (0 == getrusage (RUSAGE_SELF, &usage)) {
+	minflt = -usage.ru_minflt;
+	majflt = -usage.ru_majflt;
+    }
     if (!build_world ()) {PANIC ("can't build world");}
+    if (0 == getrusage (RUSAGE_SELF, &usage)) {
+	minflt += usage.ru_minflt;
+	majflt += usage.ru_majflt;
+    }
     init_game ();
 
     /* Perform sanity checks. */
     if (0 != sanity_check ()) {
 	PANIC ("failed sanity checks");
     }
+    if (0 != build_cmd_trie ()) {
+	PANIC ("can't build typed command table");
+    }
 
-    /* Create status message thread. */
-    if (0 != pthread_create (&status_thread_id, NULL, status_thread, NULL)) {
-        PANIC ("failed to create status thread");
+    /* Run a script of typed commands in batch mode. */
+    if (NULL == script && 1 < argc) {
+	ret = (0 == run_batch (argv[2], (4 == argc ? atoi (argv[3]) : 1)) ?
+	       0 : 1);
+	free_world ();
+	return ret;
     }
-    push_cleanup (cancel_status_thread, NULL); {
 
-	/* Start mode X. */
-	if (0 != set_mode_X (fill_horiz_buffer, fill_vert_buffer)) {
-	    PANIC ("cannot initialize mode X");
+    /* Time each phase of the event loop; SIGUSR1 prints the histograms. */
+    prof_set_budget (TICK_USEC * 1000ULL);
+    prof_dump_on_signal (SIGUSR1);
+    push_cleanup (dump_frame_times, NULL); {
+
+	/* Create the event loop's timers and status message eventfd. */
+	if (0 != open_events ()) {
+	    PANIC ("failed to create event loop");
 	}
-	push_cleanup ((cleanup_fn_t)clear_mode_X, NULL); {
+	push_cleanup (close_events, NULL); {
 
-	    /* Initialize the keyboard and/or Tux controller. */
-	    if (0 != init_input ()) {
-		PANIC ("cannot initialize input");
+	    /* Start mode X. */
+	    if (0 != set_mode_X (fill_horiz_buffer, fill_vert_buffer)) {
+		PANIC ("cannot initialize mode X");
 	    }
-	    push_cleanup ((cleanup_fn_t)shutdown_input, NULL); {
 
-		game = game_loop ();
+	    /* Split full-room redraws across CPUs (stopped by clear_mode_X). */
+	    (void)set_redraw_threads (0 < REDRAW_THREADS ? REDRAW_THREADS :
+				      sysconf (_SC_NPROCESSORS_ONLN));
+	    push_cleanup ((cleanup_fn_t)clear_mode_X, NULL); {
+
+		/* Start the render thread, which does all drawing. */
+		if (0 != start_renderer ()) {
+		    PANIC ("cannot start render thread");
+		}
+		push_cleanup ((cleanup_fn_t)stop_renderer, NULL); {
+
+		    if (NULL != script) {
+			(void)clock_gettime (CLOCK_MONOTONIC, &run_start);
+			game = replay (script);
+			(void)clock_gettime (CLOCK_MONOTONIC, &run_end);
+#if defined(REPLAY_PROGRAM)
+			frame_hash = vga_frame_hash ();
+#endif
+		    } else {
+			/* Initialize the keyboard and/or Tux controller. */
+			if (0 != init_input ()) {
+			    PANIC ("cannot initialize input");
+			}
+			push_cleanup ((cleanup_fn_t)shutdown_input, NULL); {
+
+			    (void)clock_gettime (CLOCK_MONOTONIC, &run_start);
+			    game = game_loop ();
+			    (void)clock_gettime (CLOCK_MONOTONIC, &run_end);
+
+			} pop_cleanup (1);
+		    }
+
+		} pop_cleanup (1);
 
 	    } pop_cleanup (1);
 
@@ -837,6 +1470,64 @@ main ()
 	case GAME_QUIT: printf ("Quitter!\n"); break;
     }
 
+    /* Report how page flipping went. */
+    get_present_stats (&stats);
+    printf ("%lu frames: %lu flips (%lu seen at retrace), %lu skipped, "
+	    "%lu torn\n", stats.frames, stats.flips, stats.retraces,
+	    stats.skipped, stats.torn);
+
+    /* Report how often scrolling found lines already drawn. */
+    get_prerender_stats (&pre);
+    printf ("%lu lines prerendered (%lu wasted); scrolling used %lu and "
+	    "drew %lu more\n", pre.drawn, pre.wasted, pre.used, 
+	    pre.on_demand);
+
+    /* Report how many Tux LED updates reached the controller. */
+    get_tux_led_stats (&leds);
+    if (0 != leds.requested) {
+	printf ("Tux LEDs: %lu updates requested, %lu packets sent (%lu "
+		"unchanged, %lu merged)\n", leds.requested, leds.sent,
+		leds.redundant, leds.merged);
+    }
+    if (0 != (lost = tux_events_lost ())) {
+	printf ("Tux: %lu button changes lost (driver queue full)\n", lost);
+    }
+
+    /* Report how the world's images were allocated. */
+    mem = get_world_memory ();
+    printf ("world: %lu allocations, %lu of %lu kB used in %lu chunks "
+	    "(%lu on huge pages); %ld minor and %ld major page faults "
+	    "loading\n", mem->allocs, (unsigned long)(mem->used >> 10),
+	    (unsigned long)(mem->reserved >> 10), mem->n_chunks, mem->n_huge,
+	    minflt, majflt);
+
+    /* Report CPU usage (all threads) while playing. */
+    if (0 == getrusage (RUSAGE_SELF, &usage)) {
+	run_sec = (run_end.tv_sec - run_start.tv_sec) +
+		  (run_end.tv_nsec - run_start.tv_nsec) / 1e9;
+	cpu_sec = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+		  usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	printf ("CPU: %.1f s in %.1f s of play (%.0f%% of one core)\n",
+		cpu_sec, run_sec, (0 < run_sec ? 100 * cpu_sec / run_sec : 0));
+    }
+
+    /* Report the frame rate of a replay. */
+    if (NULL != script) {
+	run_sec = (run_end.tv_sec - run_start.tv_sec) +
+		  (run_end.tv_nsec - run_start.tv_nsec) / 1e9;
+	printf ("replay: %lu frames in %.3f s (%.1f frames/s, %.1f us/frame)\n",
+		stats.frames, run_sec, 
+		(0 < run_sec ? stats.frames / run_sec : 0),
+		(0 < stats.frames ? 1e6 * run_sec / stats.frames : 0));
+#if defined(REPLAY_PROGRAM)
+	printf ("replay: final frame hash %016llx\n",
+		(unsigned long long)frame_hash);
+#endif
+    }
+
+    /* Free all of the world's images in one step. */
+    free_world ();
+
     /* Return success. */
     return 0;
 }
@@ -885,6 +1576,14 @@ sanity_check ()
 	cnt[cmd_list[idx].cmd]++;
     }
 
+    /* Check that every typed command has a handler. */
+    for (idx = 0; NUM_TC_VALUES > idx; idx++) {
+        if (NULL == cmd_fn[idx]) {
+	    fprintf (stderr, "TC_ #%d has no handler.\n", idx);
+	    ret_val = -1;
+	}
+    }
+
     /* 
      * Now check that every typed command can be issued with some string. 
      * We could be fancier and check that it's possible to match (shadowing
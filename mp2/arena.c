@@ -0,0 +1,180 @@
+/*									tab:8
+ *
+ * arena.c - arena allocator for the adventure game
+ *
+ * Filename:	    arena.c
+ *
+ * Each chunk is an anonymous mapping that starts with a small header
+ * linking it to the previously mapped chunk; allocations bump a pointer
+ * through the newest chunk.  When a request does not fit in the rest of
+ * the newest chunk, a new chunk is mapped (larger than the usual size if
+ * need be) and the old chunk's remainder is abandoned.  If asked to, the
+ * arena maps chunks in whole huge pages, aligned to huge page boundaries,
+ * and advises the kernel to back them with transparent huge pages, which
+ * cuts both page faults and TLB misses when the data are touched.
+ */
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "arena.h"
+
+
+#define HUGE_PAGE_SIZE (2UL << 20) /* x86 huge page size in bytes */
+
+/* header at the start of each chunk */
+struct arena_chunk_t {
+    arena_chunk_t* next; /* previously mapped chunk */
+    size_t         size; /* bytes mapped            */
+};
+
+/* bytes at the start of a chunk used by its header */
+#define CHUNK_HDR \
+    ((sizeof (arena_chunk_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+
+/* local functions--see function headers for details */
+static int32_t add_chunk (arena_t* a, size_t n);
+static void* map_chunk (size_t size, int32_t huge, int32_t* advised);
+
+
+/*
+ * arena_alloc
+ *   DESCRIPTION: Allocate memory from an arena.  The memory is aligned
+ *                to ARENA_ALIGN bytes and filled with zeroes.
+ *   INPUTS: a -- the arena
+ *           n -- number of bytes needed
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the memory, or NULL on failure
+ *   SIDE EFFECTS: may map a new chunk
+ */
+void*
+arena_alloc (arena_t* a, size_t n)
+{
+    size_t padded = (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    void*  mem;     /* memory allocated */
+
+    if (padded < n || (padded > a->left && 0 != add_chunk (a, padded))) {
+        return NULL;
+    }
+    mem = a->next;
+    a->next += padded;
+    a->left -= padded;
+    a->allocs++;
+    a->used += n;
+    return mem;
+}
+
+
+/*
+ * arena_release
+ *   DESCRIPTION: Unmap all of an arena's chunks.  The counters are reset
+ *                along with the arena, which can then be used again.
+ *   INPUTS: a -- the arena
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees all memory allocated from the arena
+ */
+void
+arena_release (arena_t* a)
+{
+    arena_chunk_t* c;    /* chunk being unmapped */
+    arena_chunk_t* next; /* chunk mapped before c */
+
+    for (c = a->chunks; NULL != c; c = next) {
+	next = c->next;
+	(void)munmap (c, c->size);
+    }
+    a->chunks = NULL;
+    a->next = NULL;
+    a->left = 0;
+    a->allocs = 0;
+    a->n_chunks = 0;
+    a->n_huge = 0;
+    a->reserved = 0;
+    a->used = 0;
+}
+
+
+/*
+ * add_chunk
+ *   DESCRIPTION: Map a new chunk big enough to hold an allocation and
+ *                make it the arena's newest chunk.
+ *   INPUTS: a -- the arena
+ *           n -- bytes needed for the allocation (padded)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, or -1 on failure
+ *   SIDE EFFECTS: maps memory
+ */
+static int32_t
+add_chunk (arena_t* a, size_t n)
+{
+    size_t         size = a->chunk_size; /* bytes to map          */
+    size_t         unit;                 /* chunk size multiple   */
+    arena_chunk_t* c;                    /* new chunk             */
+    int32_t        advised;              /* 1 if huge pages given */
+
+    if (CHUNK_HDR + n > size) {
+        size = CHUNK_HDR + n;
+    }
+    unit = (a->huge ? HUGE_PAGE_SIZE : (size_t)sysconf (_SC_PAGESIZE));
+    size = (size + unit - 1) & ~(unit - 1);
+    if (NULL == (c = map_chunk (size, a->huge, &advised))) {
+        return -1;
+    }
+    c->next = a->chunks;
+    c->size = size;
+    a->chunks = c;
+    a->next = (uint8_t*)c + CHUNK_HDR;
+    a->left = size - CHUNK_HDR;
+    a->n_chunks++;
+    a->n_huge += advised;
+    a->reserved += size;
+    return 0;
+}
+
+
+/*
+ * map_chunk
+ *   DESCRIPTION: Map zero-filled memory for a chunk.  For huge pages, the
+ *                mapping is aligned to a huge page boundary by mapping
+ *                an extra huge page and unmapping the excess around the
+ *                aligned part.
+ *   INPUTS: size -- bytes to map (a multiple of the page size, or of the
+ *                   huge page size if huge is set)
+ *           huge -- 1 to ask for transparent huge pages
+ *   OUTPUTS: advised -- 1 if the kernel accepted the huge page advice,
+ *                       or 0 if not
+ *   RETURN VALUE: pointer to the mapping, or NULL on failure
+ *   SIDE EFFECTS: maps memory
+ */
+static void*
+map_chunk (size_t size, int32_t huge, int32_t* advised)
+{
+    uint8_t* raw;   /* mapping, before alignment */
+    uint8_t* start; /* aligned start of chunk    */
+    size_t   extra; /* bytes mapped for alignment */
+
+    *advised = 0;
+    extra = (huge ? HUGE_PAGE_SIZE : 0);
+    raw = mmap (NULL, size + extra, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == raw) {
+        return NULL;
+    }
+    if (!huge) {
+        return raw;
+    }
+    start = (uint8_t*)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) &
+		       ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (start > raw) {
+	(void)munmap (raw, start - raw);
+    }
+    if (raw + extra > start) {
+	(void)munmap (start + size, raw + extra - start);
+    }
+#if defined(MADV_HUGEPAGE)
+    *advised = (0 == madvise (start, size, MADV_HUGEPAGE));
+#endif
+    return start;
+}
@@ -0,0 +1,52 @@
+/*									tab:8
+ *
+ * arena.h - header file for the adventure game's arena allocator
+ *
+ * Filename:	    arena.h
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * An arena hands out memory from large chunks mapped from the kernel and
+ * gives it all back at once: there is no way to free one allocation.  It
+ * suits data that live until a known point, such as the world's images.
+ * Arenas are not thread-safe.
+ */
+
+#define ARENA_ALIGN 16 /* alignment of every allocation */
+
+typedef struct arena_chunk_t arena_chunk_t;
+
+typedef struct arena_t arena_t;
+struct arena_t {
+    arena_chunk_t* chunks;     /* chunks mapped, newest first          */
+    uint8_t*       next;       /* next free byte in newest chunk       */
+    size_t         left;       /* bytes free after next                */
+    size_t         chunk_size; /* usual chunk size in bytes            */
+    int32_t        huge;       /* 1 to ask for transparent huge pages  */
+    unsigned long  allocs;     /* allocations made                     */
+    unsigned long  n_chunks;   /* chunks mapped                        */
+    unsigned long  n_huge;     /* chunks the kernel will back with huge */
+                               /*   pages                              */
+    size_t         reserved;   /* bytes mapped                         */
+    size_t         used;       /* bytes allocated (without padding)    */
+};
+
+/* initializer for an empty arena */
+#define ARENA_INIT(chunk_size,huge) \
+    {NULL, NULL, 0, (chunk_size), (huge), 0, 0, 0, 0, 0}
+
+/* Allocate n bytes from an arena.  Returns NULL on failure. */
+extern void* arena_alloc (arena_t* a, size_t n);
+
+/* Free everything allocated from an arena, leaving it empty. */
+extern void arena_release (arena_t* a);
+
+#endif /* ARENA_H */
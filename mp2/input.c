@@ -55,10 +55,10 @@
 #include <termio.h>
 #include <termios.h>
 #include <unistd.h>
-#include <pthread.h>								//include this to run threads
 
 #include "assert.h"
 #include "input.h"
+#include "prof.h"
 
 #include "module/tuxctl-ioctl.h"					//included to use functions and variables from tuxctl-ioctl and module
 
@@ -73,21 +73,37 @@
 *	magic numbers		*
 ************************/
 #define time_limit 60
-#define one_sec 1000000
 #define max_min_tux 99
 #define max_sec_tux 59
+
+/*
+ * A TUX_SET_LED packet (6 bytes) and its ACK (3 bytes) take about 9.4 ms
+ * at 9600 baud, so LED updates are sent no more often than this.
+ */
+#define LED_PACKET_NSEC 10000000
 static struct termios tio_orig;
 /* stores original terminal settings */
 
 	/**********************************************************
 	 *	Declaring global variables
-	 *	We declare a thread here to take care of timing issues
 	*************************************************************/ 
-// pthread_t clock_display;
-int fd;									
-cmd_t pressedbutton = CMD_NONE;
-int pushedbutton;
-pthread_t clock_display;
+int fd = -1;									//Tux controller port, or -1 if not open
+
+/*
+ * The Tux controller's LEDs are updated through a channel that sends only
+ * what would change the display: a value equal to the one shown is
+ * dropped, and a value requested while the serial line is still busy
+ * with the last packet waits in led_next, replaced by any newer value,
+ * until flush_tux_leds finds the line free.
+ */
+static unsigned long   led_shown;       /* value last sent              */
+static unsigned long   led_next;        /* value waiting to be sent     */
+static int32_t         led_valid = 0;   /* led_shown has been sent      */
+static int32_t         led_pending = 0; /* led_next is waiting          */
+static uint64_t        led_sent_at;     /* time of last send (prof_now) */
+static tux_led_stats_t led_stats;       /* update counters              */
+
+static void set_tux_leds (unsigned long value);
 
 /* 
  * init_input
@@ -123,9 +139,10 @@ init_input ()
 	 *	to the computer						*
 	****************************************/
  
-    fd = open("/dev/ttyS0", O_RDWR | O_NOCTTY);					
+    fd = open("/dev/ttyS0", O_RDWR | O_NOCTTY | O_NONBLOCK);	//non-blocking: get_command drains button events
 	int ldisc_num = N_MOUSE;
 	ioctl (fd, TIOCSETD, &ldisc_num);								
+	ioctl (fd, TUX_INIT);									//turn on button events (MTCP_BIOC_ON)
 	
   
 	/*
@@ -136,11 +153,6 @@ init_input ()
 	return -1;
     }
 
-	/****************************************************************
-	* start a timer thread to act as a counter which is displayed	*
-	* It is the same as using the predefined clock					*	
-	****************************************************************/
-    
     /*
      * Turn off canonical (line-buffered) mode and echoing of keystrokes
      * to the monitor.  Set minimal character and timing parameters so as
@@ -160,6 +172,7 @@ init_input ()
 }
 
 static char typing[MAX_TYPED_LEN + 1] = {'\0'};
+static int32_t typing_changed = 0;  /* typing changed since last query */
 
 const char*
 get_typed_command ()
@@ -170,7 +183,29 @@ get_typed_command ()
 void
 reset_typed_command ()
 {
-    typing[0] = '\0';
+    if ('\0' != typing[0]) {
+        typing[0] = '\0';
+	typing_changed = 1;
+    }
+}
+
+/* 
+ * typed_changed
+ *   DESCRIPTION: Check whether the typed command has changed since the
+ *                last call, e.g., because get_command applied keystrokes
+ *                left queued behind a command by an earlier read.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the typed command changed, 0 if not
+ *   SIDE EFFECTS: clears the changed flag
+ */
+int32_t
+typed_changed ()
+{
+    int32_t changed = typing_changed;
+
+    typing_changed = 0;
+    return changed;
 }
 
 static int32_t
@@ -188,260 +223,334 @@ typed_a_char (char c)
     if (8 == c || 127 == c) {
         if (0 < len) {
 	    typing[len - 1] = '\0';
+	    typing_changed = 1;
 	}
     } else if (MAX_TYPED_LEN > len) {
 	typing[len] = c;
 	typing[len + 1] = '\0';
+	typing_changed = 1;
     }
 }
 	
-	/************************************************************************
-	*	This function takes in a parameter and initializes the clock on		*
-	*	the display. We basically use this to convert into seconds and 		*
-	*	minutes. Moreover, we get a clock working in hexadecimal and 		*
-	*	we need to convert it to decimal numbers to show on the LEDsd		*
-	* It is the same as using the predefined clock							*	
-	************************************************************************/
-void *timer(void * arg)
+
+/*
+ * Keystrokes are read with one read per call to get_command and decoded
+ * by a table-driven state machine: each byte falls into a class (see
+ * byte_class), and the decoder's state and the byte's class select the
+ * next state and an action (see key_fsm).  Arrow keys deliver the bytes
+ * 27, 91, and 'A' to 'D'; insert, home, and page up keys deliver 27, 91,
+ * '2'/'1'/'5', and a tilde.  Decoded keystrokes wait in a queue, stamped
+ * with the time at which they were read, so that a burst of keys that
+ * arrives between ticks is handed out in order rather than merged or
+ * dropped.  We never read more bytes than the queue has room for; the
+ * rest wait in the terminal until the next call.
+ *
+ * Tux controller buttons arrive the same way: the driver queues each
+ * change in the buttons held, stamped with its arrival time, and we read
+ * the changes in batches (see read_tux).  Both the keyboard and the
+ * controller are read only when the caller reports that they have data,
+ * so an idle tick makes no system calls.
+ */
+
+#define INPUT_QUEUE_SIZE 64 /* queued keystrokes (a power of two) */
+#define TUX_BATCH        16 /* button events read at once          */
+
+/* classes of bytes read from the keyboard */
+typedef enum {
+    BC_OTHER,   /* anything else                     */
+    BC_ESC,     /* 27, starting an escape sequence    */
+    BC_BRACKET, /* '['                               */
+    BC_ARROW,   /* 'A' to 'D', ending an arrow key    */
+    BC_EDIT,    /* '1', '2', or '5' (home/insert/pgup) */
+    BC_TILDE,   /* '~', ending an editing key         */
+    BC_NEWLINE, /* 10 or 13, executing typed command  */
+    BC_QUIT,    /* backquote, quitting the game       */
+    NUM_BYTE_CLASSES
+} byte_class_t;
+
+/* states of the keystroke decoder */
+typedef enum {
+    KS_GROUND,  /* not in an escape sequence       */
+    KS_ESC,     /* after 27                        */
+    KS_CSI,     /* after 27 and '['                */
+    KS_TILDE,   /* after an editing key's digit    */
+    NUM_KEY_STATES
+} key_state_t;
+
+/* actions of the keystroke decoder */
+typedef enum {
+    KA_NONE,    /* discard the byte                        */
+    KA_TYPE,    /* queue the byte as typing, if valid      */
+    KA_KEY,     /* queue the byte's command (see key_cmd)  */
+    KA_ENTER,   /* queue CMD_TYPED                         */
+    KA_QUIT     /* queue CMD_QUIT                          */
+} key_action_t;
+
+/* a transition of the keystroke decoder */
+typedef struct {
+    uint8_t next;   /* next state (key_state_t)        */
+    uint8_t action; /* action to take (key_action_t)   */
+} key_step_t;
+
+/* a decoded keystroke */
+typedef struct {
+    uint64_t when;  /* time read (see prof_now)             */
+    cmd_t    cmd;   /* command, or CMD_NONE for typing      */
+    char     ch;    /* character typed (if cmd is CMD_NONE) */
+} input_event_t;
+
+/* 
+ * class of each byte; in Tux controller mode, escape sequences are not
+ * decoded, so their bytes are just (mostly invalid) typing
+ */
+static const uint8_t byte_class[256] = {
+#if (USE_TUX_CONTROLLER == 0)
+    [27] = BC_ESC,
+#endif
+    ['['] = BC_BRACKET,
+    ['A'] = BC_ARROW, ['B'] = BC_ARROW, ['C'] = BC_ARROW, ['D'] = BC_ARROW,
+    ['1'] = BC_EDIT, ['2'] = BC_EDIT, ['5'] = BC_EDIT,
+    ['~'] = BC_TILDE,
+    [10] = BC_NEWLINE, [13] = BC_NEWLINE,
+    ['`'] = BC_QUIT
+};
+
+/*
+ * transitions of the keystroke decoder, by state and byte class; a byte
+ * that breaks off a sequence is handled as if no sequence had begun
+ * (we may thus discard an ESC or a bracket, but neither is valid typing)
+ */
+#define STEP(next,action) {KS_##next, KA_##action}
+static const key_step_t key_fsm[NUM_KEY_STATES][NUM_BYTE_CLASSES] = {
+    [KS_GROUND] = {
+	[BC_OTHER] = STEP (GROUND, TYPE),  [BC_ESC] = STEP (ESC, NONE),
+	[BC_BRACKET] = STEP (GROUND, TYPE), [BC_ARROW] = STEP (GROUND, TYPE),
+	[BC_EDIT] = STEP (GROUND, TYPE),   [BC_TILDE] = STEP (GROUND, TYPE),
+	[BC_NEWLINE] = STEP (GROUND, ENTER), [BC_QUIT] = STEP (GROUND, QUIT)
+    },
+    [KS_ESC] = {
+	[BC_OTHER] = STEP (GROUND, TYPE),  [BC_ESC] = STEP (GROUND, NONE),
+	[BC_BRACKET] = STEP (CSI, NONE),   [BC_ARROW] = STEP (GROUND, TYPE),
+	[BC_EDIT] = STEP (GROUND, TYPE),   [BC_TILDE] = STEP (GROUND, TYPE),
+	[BC_NEWLINE] = STEP (GROUND, ENTER), [BC_QUIT] = STEP (GROUND, QUIT)
+    },
+    [KS_CSI] = {
+	[BC_OTHER] = STEP (GROUND, TYPE),  [BC_ESC] = STEP (GROUND, NONE),
+	[BC_BRACKET] = STEP (GROUND, TYPE), [BC_ARROW] = STEP (GROUND, KEY),
+	[BC_EDIT] = STEP (TILDE, KEY),     [BC_TILDE] = STEP (GROUND, TYPE),
+	[BC_NEWLINE] = STEP (GROUND, ENTER), [BC_QUIT] = STEP (GROUND, QUIT)
+    },
+    [KS_TILDE] = {
+	[BC_OTHER] = STEP (GROUND, TYPE),  [BC_ESC] = STEP (GROUND, NONE),
+	[BC_BRACKET] = STEP (GROUND, TYPE), [BC_ARROW] = STEP (GROUND, TYPE),
+	[BC_EDIT] = STEP (GROUND, TYPE),   [BC_TILDE] = STEP (GROUND, NONE),
+	[BC_NEWLINE] = STEP (GROUND, ENTER), [BC_QUIT] = STEP (GROUND, QUIT)
+    }
+};
+#undef STEP
+
+/* command for the last byte of each escape sequence */
+static const cmd_t key_cmd[256] = {
+    ['A'] = CMD_UP, ['B'] = CMD_DOWN, ['C'] = CMD_RIGHT, ['D'] = CMD_LEFT,
+    ['2'] = CMD_MOVE_LEFT, ['1'] = CMD_ENTER, ['5'] = CMD_MOVE_RIGHT
+};
+
+/* 
+ * command for each Tux controller button, by bit number in a tux_event:
+ * START, A, B, C, up, left, down, right
+ */
+static const cmd_t tux_cmd[8] = {
+    CMD_QUIT, CMD_MOVE_LEFT, CMD_ENTER, CMD_MOVE_RIGHT,
+    CMD_UP, CMD_LEFT, CMD_DOWN, CMD_RIGHT
+};
+
+static input_event_t input_queue[INPUT_QUEUE_SIZE]; /* decoded keystrokes */
+static uint32_t q_head = 0; /* events taken (wraps)       */
+static uint32_t q_tail = 0; /* events queued (wraps)      */
+static uint8_t tux_buttons = 0xFF; /* Tux buttons held (active low)  */
+static uint64_t input_time = 0; /* arrival of oldest input taken by the */
+				/*   last get_command, or 0 if none     */
+
+/* 
+ * queue_event
+ *   DESCRIPTION: Add a keystroke or controller command to the input
+ *                queue, unless the queue is full.
+ *   INPUTS: when -- time at which the input was read
+ *           cmd -- command, or CMD_NONE for a typed character
+ *           ch -- character typed (if cmd is CMD_NONE)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: drops the input if the queue is full
+ */
+static void
+queue_event (uint64_t when, cmd_t cmd, char ch)
 {
-	/*int counter = 0; 									//keeps count of the time lapse 
-	int minutes = 0;									
-	int seconds = 0;									
-	
-	while(1)											//start infinite loop so that time not affected
-	{
-		minutes = counter / time_limit;							//convert time in hex to decimals
-		seconds = counter % time_limit;							
-		if(minutes > max_min_tux)								//to reset clock to zero when it goes to 99 min and 59 sec
-			minutes = 0;
-		if(seconds > max_sec_tux)
-			seconds = 0;
-		unsigned long buf_time = 0xF4FF0000;			//This call SET_LED so we follow the convention of the received arg
-		if(minutes < 10)
-			buf_time = buf_time & 0xFFF7FFFF;		
-		buf_time = buf_time | ((minutes & 0x000000FF)<<8);	
-		buf_time = buf_time | (seconds & 0x000000FF);		//have final arg value in buffer
-		ioctl (fd, TUX_SET_LED, buf_time);					//this sends to tux to display. 	
-		counter++;										 		
-		usleep(one_sec);								//this just slows the loop to 1 sec so that the timer increases by 1 sec  
-	}			*/										
+    input_event_t* ev; /* slot for the event */
+
+    if (INPUT_QUEUE_SIZE == q_tail - q_head) {
+        return;
+    }
+    ev = &input_queue[q_tail++ % INPUT_QUEUE_SIZE];
+    ev->when = when;
+    ev->cmd = cmd;
+    ev->ch = ch;
 }
 
-	/************************************************************************ 
-	 * get_command 															*		
-	 *   DESCRIPTION: Reads a command from the input controller.  As some 	*
-	 *                controllers provide only absolute input (e.g., go 	*
-	 *                right), the current direction is needed as an input 	*
-	 *                to this routine.										*
-	 *   INPUTS: cur_dir -- current direction of motion 					*
-	 *   OUTPUTS: none 														*
-	 *   RETURN VALUE: command issued by the input controller 				*
-	 *   SIDE EFFECTS: drains any keyboard input 							*
-	 ***********************************************************************/
-
-	/************************************************************************
-	*	This function used GET COMMAND to take in values from the TUX and 	*
-	*	map it to the commands. Up, down, left, right , quiz, enter,  		*
-	*	move_left, and move right are mapped to the respective buttons.		*
-	*	This enables us to use the TUX in the game and we can control the 	*
-	* 	motion of the display or the picture. 								*	
-	* 	This is exactly similar to the get_command function in advecture.c	*
-	* 																		*
-	*	Handle synchronous events--in this case, only player commands.		* 
-	* 	Note that typed commands that move objects may cause the room		*
-	* 	to be redrawn.														*
-	************************************************************************/
-cmd_t
-get_tux_command(cmd_t *pushed)
+/* 
+ * read_keys
+ *   DESCRIPTION: Read the keystrokes waiting on stdin (as many as the
+ *                input queue has room for) with one read, decode them,
+ *                and queue the results.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: reads from stdin; changes the decoder state
+ */
+static void
+read_keys ()
 {
-									
-	int arg = 0xFFFFFF00;									//since we take active low, we make all 1s to show no button is pressesed  
-		
-	ioctl(fd, TUX_BUTTONS, &arg);							//this ioctl updates the arg to tell which button is kept pressed
-/*	We separate these buttons to basically show which buttons should work when kept pressed */
-	switch (arg)
-	{
-	    case 239: *pushed = CMD_UP;							
-	    	break; 								
-	    case 127: *pushed = CMD_RIGHT;  						//these buttons work when kept pressed
-	    	break; 				
-	    case 191: *pushed = CMD_DOWN;    
-	    	break; 				
-	    case 223: *pushed = CMD_LEFT; 						//direction mapped with above comment
-	    	break;  			
-	    default: 
-	    	break;
-	}
-/*	We separate these buttons to basically show which buttons should not work when kept pressed */
-	if(arg != pushedbutton)
-	{
-		pushedbutton = arg;
-		switch(arg)
-		{
-			case 253: *pushed = CMD_MOVE_LEFT;				
-				break;		
-	    	case 251: *pushed = CMD_ENTER;	 				//these buttons only work when presses again and again
-	    		break;		
-	    	case 247: *pushed = CMD_MOVE_RIGHT;	
-	    		break;		
-			case 254: *pushed = CMD_QUIT; 					//direction mapped with above comment
-				break;		
-			default:
-				break;
+    static key_state_t state = KS_GROUND; /* decoder state between calls */
+    uint8_t    buf[INPUT_QUEUE_SIZE];     /* bytes read                  */
+    uint32_t   room;                      /* free slots in queue         */
+    ssize_t    n;                         /* number of bytes read        */
+    ssize_t    i;                         /* index over bytes            */
+    uint64_t   now;                       /* time of the read            */
+    key_step_t step;                      /* decoder transition          */
+
+    /* Each byte yields at most one event, so the queue cannot overflow. */
+    room = INPUT_QUEUE_SIZE - (q_tail - q_head);
+    if (0 == room || 0 >= (n = read (fileno (stdin), buf, room))) {
+        return;
+    }
+    now = prof_now ();
+    for (i = 0; n > i; i++) {
+	step = key_fsm[state][byte_class[buf[i]]];
+	state = step.next;
+	switch (step.action) {
+	    case KA_TYPE:
+		if (valid_typing (buf[i])) {
+		    queue_event (now, CMD_NONE, buf[i]);
 		}
+		break;
+	    case KA_KEY:   queue_event (now, key_cmd[buf[i]], 0); break;
+	    case KA_ENTER: queue_event (now, CMD_TYPED, 0);       break;
+	    case KA_QUIT:  queue_event (now, CMD_QUIT, 0);        break;
 	}
-return *pushed;
+    }
 }
 
 /* 
- * get_command
- *   DESCRIPTION: Reads a command from the input controller.  As some
- *                controllers provide only absolute input (e.g., go
- *                right), the current direction is needed as an input
- *                to this routine.
- *   INPUTS: cur_dir -- current direction of motion
+ * read_tux
+ *   DESCRIPTION: Read the button changes queued by the Tux controller
+ *                driver (as many as the input queue has room for) and
+ *                queue the commands they give, stamped with the times at
+ *                which the driver received them.  Pressing a button gives
+ *                its command once, however briefly it is held.
+ *   INPUTS: none
  *   OUTPUTS: none
- *   RETURN VALUE: command issued by the input controller
- *   SIDE EFFECTS: drains any keyboard input
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: reads from the Tux controller; updates tux_buttons
  */
-
-cmd_t 
-get_command ()
+static void
+read_tux ()
 {
-	   
-#if (USE_TUX_CONTROLLER == 0) /* use keyboard control with arrow keys */
-    static int state = 0;             /* small FSM for arrow keys */
-
-#endif
-    static cmd_t command = CMD_NONE;
-    cmd_t pushed = CMD_NONE;
-    int ch;
-
-    /* Read all characters from stdin. */
-    while ((ch = getc (stdin)) != EOF) {
-
-	/* Backquote is used to quit the game. */
-	if (ch == '`')
-	    return CMD_QUIT;
-	
-#if (USE_TUX_CONTROLLER == 0) /* use keyboard control with arrow keys */
-	/*
-	 * Arrow keys deliver the byte sequence 27, 91, and 'A' to 'D';
-	 * we use a small finite state machine to identify them.
-	 *
-	 * Insert, home, and page up keys deliver 27, 91, '2'/'1'/'5' and
-	 * then a tilde.  We recognize the digits and don't check for the
-	 * tilde.
-	 */
-	switch (state) {
-	    case 0:
-	        if (27 == ch) {
-		    state = 1;
-		} else if (valid_typing (ch)) {
-		    typed_a_char (ch);
-		} else if (10 == ch || 13 == ch) {
-		    pushed = CMD_TYPED;
-		}
-		break;
-	    case 1:
-		if (91 == ch) {
-		    state = 2;
-		} else {
-		    state = 0;
-		    if (valid_typing (ch)) {
-			/*
-			 * Note that we may be discarding an ESC (27), but
-			 * we don't use that as typed input anyway.
-			 */
-			typed_a_char (ch);
-		    } else if (10 == ch || 13 == ch) {
-			pushed = CMD_TYPED;
-		    }
-		}
-		break;
-	    case 2:
-	        if (ch >= 'A' && ch <= 'D') {
-		    switch (ch) {
-			case 'A': pushed = CMD_UP; break;
-			case 'B': pushed = CMD_DOWN; break;
-			case 'C': pushed = CMD_RIGHT; break;
-			case 'D': pushed = CMD_LEFT; break;
-		    }
-		    state = 0;
-		} else if (ch == '1' || ch == '2' || ch == '5') {
-		    switch (ch) {
-			case '2': pushed = CMD_MOVE_LEFT; break;
-			case '1': pushed = CMD_ENTER; break;
-			case '5': pushed = CMD_MOVE_RIGHT; break;
-		    }
-		    state = 3; /* Consume a '~'. */
-		} else {
-		    state = 0;
-		    if (valid_typing (ch)) {
-			/*
-			 * Note that we may be discarding an ESC (27) and 
-			 * a bracket (91), but we don't use either as 
-			 * typed input anyway.
-			 */
-			typed_a_char (ch);
-		    } else if (10 == ch || 13 == ch) {
-			pushed = CMD_TYPED;
-		    }
-		}
-		break;
-	    case 3:
-		state = 0;
-	        if ('~' == ch) {
-		    /* Consume it silently. */
-		} else if (valid_typing (ch)) {
-		    typed_a_char (ch);
-		} else if (10 == ch || 13 == ch) {
-		    pushed = CMD_TYPED;
-		}
-		break;
+    struct tux_event ev[TUX_BATCH]; /* button changes read         */
+    uint32_t room;                  /* free slots in input queue   */
+    ssize_t  n;                     /* number of changes read      */
+    ssize_t  i;                     /* index over changes          */
+    uint8_t  down;                  /* buttons pressed by a change */
+    int32_t  b;                     /* index over buttons          */
+
+    /* A change may press all eight buttons; read only what surely fits. */
+    room = (INPUT_QUEUE_SIZE - (q_tail - q_head)) / 8;
+    if (TUX_BATCH < room) {
+        room = TUX_BATCH;
+    }
+    if (0 > fd || 0 == room || 
+	0 >= (n = read (fd, ev, room * sizeof (ev[0])))) {
+        return;
+    }
+    for (i = 0; n / (ssize_t)sizeof (ev[0]) > i; i++) {
+	down = ev[i].changed & ~ev[i].buttons;
+	for (b = 0; 8 > b; b++) {
+	    if (0 != (down & (1 << b))) {
+		queue_event (ev[i].time_ns, tux_cmd[b], 0);
+	    }
 	}
-#else /* USE_TUX_CONTROLLER */
-
-
-
-
-
-/********************************************************************************
-* 	To decide the case number for the various cases, we will follow the 	*
-*	diagram below. This has been taken from mtcp.h in modules.		*
-*										*
-*	+---7---+--6---+---5--+-4--+-3-+-2-+-1-+---0---+			*	
-*	| right | down | left | up | C | B | A | START |			*	
-*	+-------+------+------+----+---+---+---+-------+			*	
-*										*
-*	Since we are checking active low/high here we will use the commands	*
-*	right - 01111111(127)   down - 10111111(191)	left - 11011111(223)	*
-*	up - 11101111(239)	C - 11110111(247)	B - 11111011(251)	*	
-*	A - 11111101(253)      	START - 11111110(254)				*					
-********************************************************************************/
+	tux_buttons = ev[i].buttons;
+    }
+}
 
-	/* Tux controller mode; still need to support typed commands. */
-	if (valid_typing (ch)) {
-	    typed_a_char (ch);
-	} else if (10 == ch || 13 == ch) {
-	    pushed = CMD_TYPED;
+/* 
+ * get_command
+ *   DESCRIPTION: Reads a command from the input controller.  Keystrokes
+ *                and Tux controller presses that arrive together are 
+ *                queued and handed out one command per call, in order:
+ *                typed characters up to the next command are added to 
+ *                the typed command, and that command is returned.  A
+ *                direction button held down by itself also repeats its
+ *                command whenever no other input is waiting.
+ *   INPUTS: ready -- input sources with data waiting (INPUT_KEYBOARD,
+ *                    INPUT_TUX, or both); others are not read
+ *   OUTPUTS: none
+ *   RETURN VALUE: command issued by the input controller, or CMD_NONE
+ *                 if none is waiting
+ *   SIDE EFFECTS: reads keyboard and Tux controller input; may change
+ *                 the typed command; sets the time returned by
+ *                 get_input_time
+ */
+cmd_t 
+get_command (uint32_t ready)
+{
+    input_event_t* ev; /* next queued input     */
+    int32_t        b;  /* index over directions */
 
+    if (0 != (ready & INPUT_TUX)) {
+        read_tux ();
+    }
+    if (0 != (ready & INPUT_KEYBOARD)) {
+        read_keys ();
+    }
+    for (b = 4; 8 > b && q_head == q_tail; b++) {
+	if ((uint8_t)~(1 << b) == tux_buttons) {
+	    queue_event (prof_now (), tux_cmd[b], 0);
 	}
+    }
 
-#endif /* USE_TUX_CONTROLLER */
+    input_time = 0;
+    if (q_head != q_tail) {
+        input_time = input_queue[q_head % INPUT_QUEUE_SIZE].when;
     }
-    pushed = get_tux_command(&pushed);
- 
-    /*
-     * Once a direction is pushed, that command remains active
-     * until a turn is taken.
-     */
-    if (pushed == CMD_NONE) {
-        command = CMD_NONE;
+    while (q_head != q_tail) {
+	ev = &input_queue[q_head++ % INPUT_QUEUE_SIZE];
+	if (CMD_NONE != ev->cmd) {
+	    return ev->cmd;
+	}
+	typed_a_char (ev->ch);
     }
-    return pushed;
+    return CMD_NONE;
 }
 
+/* 
+ * get_input_time
+ *   DESCRIPTION: Get the time at which the oldest input (keystroke or
+ *                controller command) taken by the last call to
+ *                get_command arrived, e.g., to measure how long its
+ *                effect takes to reach the screen.  Inputs are taken in
+ *                order, so this input is the first one taken.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: arrival time (see prof_now), or 0 if the call took no
+ *                 input
+ *   SIDE EFFECTS: none
+ */
+uint64_t
+get_input_time ()
+{
+    return input_time;
+}
+
+
 /* 
  * shutdown_input
  *   DESCRIPTION: Cleans up state associated with input control.  Restores
@@ -458,40 +567,148 @@ shutdown_input ()
 }
 
 
+/* 
+ * tux_fd
+ *   DESCRIPTION: Get the file descriptor of the Tux controller's serial
+ *                port, e.g., to wait for it to become readable.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the file descriptor, or -1 if the port is not open
+ *   SIDE EFFECTS: none
+ */
+int
+tux_fd ()
+{
+    return fd;
+}
+
+
 /* 
  * display_time_on_tux
  *   DESCRIPTION: Show number of elapsed seconds as minutes:seconds
- *                on the Tux controller's 7-segment displays.
+ *                on the Tux controller's 7-segment displays.  The game
+ *                loop calls this once a second from its timer wheel.
  *   INPUTS: num_seconds -- total seconds elapsed so far
  *   OUTPUTS: none
  *   RETURN VALUE: none 
- *   SIDE EFFECTS: changes state of controller's display
+ *   SIDE EFFECTS: changes state of controller's display (see set_tux_leds)
  */
- void * display_time_on_tux(int *num_seconds)
- {
- 	int counter = 0; 									//keeps count of the time lapse 
-	int minutes = 0;									
-	int seconds = 0;									
-	
-	while(1)											//start infinite loop so that time not affected
-	{
-		minutes = counter / time_limit;							//convert time in hex to decimals
-		seconds = counter % time_limit;							
-		if(minutes > max_min_tux)								//to reset clock to zero when it goes to 99 min and 59 sec
-			minutes = 0;
-		if(seconds > max_sec_tux)
-			seconds = 0;
-		unsigned long buf_time = 0xF4FF0000;			//This call SET_LED so we follow the convention of the received arg
-		if(minutes < 10)
-			buf_time = buf_time & 0xFFF7FFFF;		
-		buf_time = buf_time | ((minutes & 0x000000FF)<<8);	
-		buf_time = buf_time | (seconds & 0x000000FF);		//have final arg value in buffer
-		ioctl (fd, TUX_SET_LED, buf_time);					//this sends to tux to display. 	
-		counter++;										 		
-		usleep(one_sec);								//this just slows the loop to 1 sec so that the timer increases by 1 sec  
-	}
-		return NULL;
- }
+void
+display_time_on_tux (int num_seconds)
+{
+	int minutes = num_seconds / time_limit;				//convert time in hex to decimals
+	int seconds = num_seconds % time_limit;
+	unsigned long buf_time = 0xF4FF0000;				//This call SET_LED so we follow the convention of the received arg
+
+	if (0 > fd)
+		return;
+	if(minutes > max_min_tux)						//to reset clock to zero when it goes to 99 min and 59 sec
+		minutes = 0;
+	if(minutes < 10)
+		buf_time = buf_time & 0xFFF7FFFF;		
+	buf_time = buf_time | ((minutes & 0x000000FF)<<8);	
+	buf_time = buf_time | (seconds & 0x000000FF);			//have final arg value in buffer
+	set_tux_leds (buf_time);					//this sends to tux to display (if it changed). 	
+}
+
+
+/* 
+ * set_tux_leds
+ *   DESCRIPTION: Ask for the Tux controller's LEDs to show a value (in
+ *                TUX_SET_LED form).  The value is dropped if the LEDs 
+ *                already show it; otherwise, it replaces any value not
+ *                yet sent and is sent as soon as the serial line is free.
+ *   INPUTS: value -- TUX_SET_LED argument
+ *   OUTPUTS: none
+ *   RETURN VALUE: none 
+ *   SIDE EFFECTS: may send a packet to the controller
+ */
+static void
+set_tux_leds (unsigned long value)
+{
+    led_stats.requested++;
+    if (led_pending) {
+	/* The waiting value is never shown. */
+        led_stats.merged++;
+	led_pending = 0;
+    }
+    if (led_valid && value == led_shown) {
+        led_stats.redundant++;
+	return;
+    }
+    led_next = value;
+    led_pending = 1;
+    flush_tux_leds ();
+}
+
+
+/* 
+ * flush_tux_leds
+ *   DESCRIPTION: Send the Tux controller the LED value waiting to be
+ *                sent, if any, once the serial line has had time to
+ *                carry the last packet.  The game loop calls this on
+ *                every tick; it makes no system calls when nothing waits.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none 
+ *   SIDE EFFECTS: may send a packet to the controller
+ */
+void
+flush_tux_leds ()
+{
+    uint64_t now; /* current time */
+
+    if (!led_pending || 0 > fd) {
+        return;
+    }
+    now = prof_now ();
+    if (led_valid && LED_PACKET_NSEC > now - led_sent_at) {
+        return;
+    }
+    (void)ioctl (fd, TUX_SET_LED, led_next);
+    led_shown = led_next;
+    led_valid = 1;
+    led_pending = 0;
+    led_sent_at = now;
+    led_stats.sent++;
+}
+
+
+/* 
+ * get_tux_led_stats
+ *   DESCRIPTION: Get the counts of Tux controller LED updates requested,
+ *                dropped, merged, and sent.
+ *   INPUTS: none
+ *   OUTPUTS: stats -- the counters
+ *   RETURN VALUE: none 
+ *   SIDE EFFECTS: none
+ */
+void
+get_tux_led_stats (tux_led_stats_t* stats)
+{
+    *stats = led_stats;
+}
+
+
+/* 
+ * tux_events_lost
+ *   DESCRIPTION: Get the number of Tux controller button changes that
+ *                the driver dropped because its event queue was full.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the number of changes lost (0 if the port is not open)
+ *   SIDE EFFECTS: none
+ */
+unsigned long
+tux_events_lost ()
+{
+    unsigned long lost = 0; /* changes lost */
+
+    if (0 <= fd) {
+	(void)ioctl (fd, TUX_LOST_EVENTS, &lost);
+    }
+    return lost;
+}
 
 
 //#error "Tux controller code is not operational yet."
@@ -521,7 +738,7 @@ main ()
 
     init_input ();
     while (1) {
-        while ((cmd = get_tux_command ()) == last_cmd);
+        while ((cmd = get_command (INPUT_TUX)) == last_cmd);
 	last_cmd = cmd;
 	printf ("command issued: %s\n", cmd_name[cmd]);
 	if (cmd == CMD_QUIT)
@@ -38,6 +38,8 @@
 #ifndef INPUT_H
 #define INPUT_H
 
+#include <stdint.h>
+
 /* possible commands from input device, whether keyboard or game controller */
 typedef enum {
     CMD_NONE, CMD_RIGHT, CMD_LEFT, CMD_UP, CMD_DOWN,
@@ -49,11 +51,18 @@ typedef enum {
 
 #define MAX_TYPED_LEN 20
 
+/* input sources with data waiting, for get_command */
+#define INPUT_KEYBOARD 1
+#define INPUT_TUX      2
+
 /* Initialize the input device. */
 extern int init_input ();
 
-/* Read a command from the input device. */
-extern cmd_t get_command ();
+/* Read a command from the input devices that have data waiting. */
+extern cmd_t get_command (uint32_t ready);
+
+/* Get the arrival time of the oldest input read by get_command (or 0). */
+extern uint64_t get_input_time ();
 
 /* Get currently typed command string. */
 extern const char* get_typed_command ();
@@ -61,17 +70,37 @@ extern const char* get_typed_command ();
 /* Reset typed command. */
 extern void reset_typed_command ();
 
+/* Check (and clear) whether the typed command changed since last asked. */
+extern int32_t typed_changed ();
+
 /* Shut down the input device. */
 extern void shutdown_input ();
 
+/* Get the Tux controller's file descriptor (-1 if not open). */
+extern int tux_fd ();
+
 /*
  * Show the elapsed seconds on the Tux controller (no effect when
  * compiled for a keyboard).
  */
-extern void *display_time_on_tux (int *num_seconds);
+extern void display_time_on_tux (int num_seconds);
+
+/* Tux controller LED update counters (see get_tux_led_stats) */
+typedef struct tux_led_stats_t tux_led_stats_t;
+struct tux_led_stats_t {
+    unsigned long requested; /* display updates asked for              */
+    unsigned long redundant; /* dropped: the LEDs already showed them  */
+    unsigned long merged;    /* replaced by a newer value before sent  */
+    unsigned long sent;      /* TUX_SET_LED packets sent               */
+};
+
+/* Send a Tux LED update held back while the serial line was busy. */
+extern void flush_tux_leds ();
 
-extern void *timer (void * arg);
+/* Get the Tux controller LED update counters. */
+extern void get_tux_led_stats (tux_led_stats_t* stats);
 
-extern cmd_t get_tux_command ();
+/* Get the number of button changes the Tux driver dropped (queue full). */
+extern unsigned long tux_events_lost ();
 
 #endif /* INPUT_H */
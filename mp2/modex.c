@@ -41,13 +41,17 @@
  */
 
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/io.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "modex.h"
+#include "prof.h"
 #include "text.h"
 
 
@@ -81,10 +85,33 @@
 #define NUM_CRTC_REGS          25
 #define NUM_GRAPHICS_REGS       9
 #define NUM_ATTR_REGS          22
+
+/* 
+ * Display pages in video memory.  The status bar occupies the first
+ * STATUS_BAR_OFFSET bytes of each plane, and each page takes 16kB per
+ * plane after that (copy_image writes 16000 bytes).  All three pages
+ * share the low byte of their start address, so a flip changes only
+ * CRTC register 0x0C.  VGA_FRAME_NSEC is the refresh period of our
+ * 70 Hz mode; once two periods pass after a flip, a vertical retrace
+ * must have latched the new start address.
+ */
+#define NUM_PAGES               3
+#define VGA_FRAME_NSEC   14285714
 //////////////////////  MAGIC NUMBERS WRITTEN BY ME   ////////////////////////////////////////////////////////////////
 #define STATUS_BAR_OFFSET   0x05A0 
 #define STATUS_BAR_ADDR_OFFSET  1440 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * STATUS_BAR_TWO_COLOR selects how print_status_bar writes video memory.
+ * When 1, the background is filled with all four planes enabled by the
+ * write mask, so one write per address colors four pixels, and only 
+ * addresses with text pixels are written again (once per plane 
+ * combination).  When 0, or if the image has more than two colors, each
+ * plane is copied.
+ */
+#define STATUS_BAR_TWO_COLOR    1
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /* VGA register settings for mode X */
 static unsigned short mode_X_seq[NUM_SEQUENCER_REGS] = {
     0x0100, 0x2101, 0x0F02, 0x0003, 0x0604
@@ -151,10 +178,34 @@ static void fill_palette_text ();
 static void write_font_data ();
 static void set_text_mode_3 (int clear_scr);
 static void copy_image (unsigned char* img, unsigned short scr_addr);
+static int vga_in_vretrace ();
+static void update_flip_state ();
+static void flip_to_page (int page);
+static int status_bar_two_color (const unsigned char* buf);
+#if !defined(TEXT_RESTORE_PROGRAM)
+static void copy_horiz_line (int y, const unsigned char buf[SCROLL_X_DIM]);
+static void copy_vert_line (int x, const unsigned char buf[SCROLL_Y_DIM]);
+static void draw_rows (int lo, int hi);
+static void* redraw_worker (void* arg);
+static void stop_redraw_workers ();
+static struct pre_line_t* find_prerendered (struct pre_line_t* side, int x,
+					    int y, int key);
+static void retire_prerendered (struct pre_line_t* line);
+static int prerender_row (int s, int y, int h);
+static int prerender_col (int s, int x, int w);
+#endif
 
 //////////////////////  THE BELOW CALL FUNCTION IS WRITTEN BY ME /////////////////
 static void copy_image2 (unsigned char * img, unsigned short scr_addr);
 //////////////////////////////////////////////////////////////////////////////////
+#if defined(REPLAY_PROGRAM)
+static void vga_reset ();
+static void vga_outb (unsigned short port, unsigned char val);
+static void vga_outw (unsigned short port, unsigned short val);
+static unsigned char vga_inb (unsigned short port);
+static void vga_write (unsigned int addr, const unsigned char* src, int n);
+static void vga_fill (unsigned int addr, unsigned char val, int n);
+#endif
 
 /* 
  * Images are built in this buffer, then copied to the video memory.
@@ -195,7 +246,28 @@ static int show_x, show_y;          /* logical view coordinates     */
 
 /* displayed video memory variables */
 static unsigned char* mem_image;    /* pointer to start of video memory */
-static unsigned short target_img;   /* offset of displayed screen image */
+static const unsigned short page_addr[NUM_PAGES] = {
+    STATUS_BAR_OFFSET,              /* offsets of display pages         */
+    STATUS_BAR_OFFSET + 0x4000, 
+    STATUS_BAR_OFFSET + 0x8000
+};
+
+/*
+ * Page flipping state.  scan_page is the page known to be scanned out by
+ * the VGA (-1 before the first flip).  flip_page has been written to the 
+ * CRTC start address but may not yet have been latched by a vertical 
+ * retrace (-1 if none).  If a frame replaces an unlatched flip, the page 
+ * it replaced might have been latched just before the write, so it is 
+ * recorded as stale_page and not reused until the newest flip is known to
+ * be on screen.  flip_armed is set once the display is seen outside of
+ * vertical retrace after the flip was written; the next retrace seen
+ * after that must have latched the flip.
+ */
+static present_mode_t present_mode = PRESENT_TRIPLE;
+static present_stats_t present_stats;
+static int scan_page, flip_page, stale_page;
+static int flip_armed;
+static struct timespec flip_time;   /* time of last start address write */
 
 
 /* 
@@ -205,8 +277,93 @@ static unsigned short target_img;   /* offset of displayed screen image */
  */
 static void (*horiz_line_fn) (int, int, unsigned char[SCROLL_X_DIM]);
 static void (*vert_line_fn) (int, int, unsigned char[SCROLL_Y_DIM]);
+
+#if !defined(TEXT_RESTORE_PROGRAM)
+/*
+ * Worker pool for draw_all_lines.  For each redraw, the caller bumps 
+ * redraw_gen and wakes the workers; worker i (from 1) draws the i'th 
+ * of n_redraw_threads row slices while the caller draws slice 0, then
+ * waits for redraw_pending to reach 0.  The line fill callback, show_x,
+ * and show_y are only read while a redraw is in progress, and each thread
+ * has its own line buffer, so the callback need only be safe to call 
+ * concurrently for different lines.
+ */
+#define MAX_REDRAW_THREADS 4
+static int n_redraw_threads = 1;       /* threads drawing, incl. caller */
+static pthread_t redraw_tid[MAX_REDRAW_THREADS];
+static pthread_mutex_t redraw_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t redraw_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t redraw_done = PTHREAD_COND_INITIALIZER;
+static unsigned int redraw_gen;        /* redraw request count       */
+static int redraw_pending;             /* workers still drawing      */
+static int redraw_quit;                /* tells workers to exit      */
+
+/* 
+ * Start-up arguments for each worker: its slice index, and the value of
+ * redraw_gen when it was created.  The worker must not sample redraw_gen
+ * itself, since draw_all_lines may have started a redraw before the new 
+ * thread first runs, and that redraw would then never be drawn.
+ */
+typedef struct {
+    int id;                            /* slice index (from 1)       */
+    unsigned int gen;                  /* last redraw already done   */
+} redraw_arg_t;
+static redraw_arg_t redraw_arg[MAX_REDRAW_THREADS];
+
+/*
+ * Prerendered lines (see prerender_lines).  Rows above (side 0) and below
+ * (side 1) the logical view window are drawn starting at show_x; columns
+ * left (side 0) and right (side 1) of the window are drawn starting at 
+ * show_y.  Each side holds PRERENDER_LINES lines, in slots indexed by the
+ * line's logical coordinate, and a line is found again by the logical
+ * position of its first pixel.  The lines are kept here rather than in 
+ * the build buffer: its planes are packed back to back, with rows exactly
+ * one window wide, so it has no room for lines outside the window.
+ */
+#define PRERENDER_LINES 8      /* lines kept past each side; power of 2 */
+typedef struct pre_line_t pre_line_t;
+struct pre_line_t {
+    int valid;                 /* image has been drawn                  */
+    int used;                  /* image has been copied into the window */
+    int x, y;                  /* logical position of first pixel       */
+    unsigned char img[SCROLL_X_DIM]; /* image (columns use SCROLL_Y_DIM) */
+};
+static pre_line_t pre_row[2][PRERENDER_LINES];
+static pre_line_t pre_col[2][PRERENDER_LINES];
+static prerender_stats_t prerender_stats;
+#endif
   
 
+#if defined(REPLAY_PROGRAM)
+/*
+ * The replay program has no VGA.  The macros below drive an emulated one
+ * in memory instead (see the vga_ functions at the end of this file),
+ * which models only what the game relies upon: the sequencer write mask,
+ * the palette DAC, the CRTC start address, and vertical retrace.  Other
+ * register writes are ignored.  Video memory writes that matter for the
+ * picture go through VMEM_FILL and copy_image/copy_image2; the mapping
+ * used by text mode is plain memory.
+ */
+#define SET_WRITE_MASK(mask_hi_bits) vga_outw (0x03C4, (mask_hi_bits) | 0x02)
+#define OUTB(port,val)               vga_outb ((port), (val))
+#define INB(port,val)                ((val) = vga_inb (port))
+#define OUTW(port,val)               vga_outw ((port), (val))
+#define REP_OUTSW(port,source,count)                                    \
+do {                                                                    \
+    int _i;                                                             \
+    for (_i = 0; _i < (count); _i++)                                    \
+        vga_outw ((port), (source)[_i]);                                \
+} while (0)
+#define REP_OUTSB(port,source,count)                                    \
+do {                                                                    \
+    int _i;                                                             \
+    for (_i = 0; _i < (count); _i++)                                    \
+        vga_outb ((port), ((unsigned char*)(source))[_i]);              \
+} while (0)
+#define VMEM_FILL(addr,val,n)        vga_fill ((addr), (val), (n))
+
+#else /* !defined(REPLAY_PROGRAM) */
+
 /* 
  * macro used to target a specific video plane or planes when writing
  * to video memory in mode X; bits 8-11 in the mask_hi_bits enable writes
@@ -231,6 +388,16 @@ do {                                                                    \
       : "memory", "cc");                                                \
 } while (0)
 
+/* macro used to read a byte from a port */
+#define INB(port,val)                                                   \
+do {                                                                    \
+    asm volatile ("                                                     \
+        inb (%w1),%b0                                                   \
+    " : "=a" ((val))                                                    \
+      : "d" ((port))                                                    \
+      : "memory");                                                      \
+} while (0)
+
 /* macro used to write two bytes to two consecutive ports */
 #define OUTW(port,val)                                                  \
 do {                                                                    \
@@ -273,6 +440,11 @@ do {                                                                    \
       : "eax", "memory", "cc");                                         \
 } while (0)
 
+/* macro used to fill video memory in the planes enabled for writing */
+#define VMEM_FILL(addr,val,n)        (void)memset (mem_image + (addr), (val), (n))
+
+#endif /* defined(REPLAY_PROGRAM) */
+
 
 /*
  * set_mode_X
@@ -316,13 +488,10 @@ set_mode_X (void (*horiz_fill_fn) (int, int, unsigned char[SCROLL_X_DIM]),
         build[BUILD_BUF_SIZE + MEM_FENCE_WIDTH + i] = MEM_FENCE_MAGIC;
     }
 
-    ///////////////////////////////////////////////////////////////////////////////////////////////////////
-    /* One display page goes at the start of video memory. */
-    target_img = STATUS_BAR_OFFSET;
+    /* No display page has been shown yet. */
+    scan_page = flip_page = stale_page = -1;
+    (void)memset (&present_stats, 0, sizeof (present_stats));
 
-    //this was originally 
-    //0x0000
-    ////////////////////////////////////////////////////////////////////////////////////////////////////////
     /* Map video memory and obtain permission for VGA port access. */
     if (open_memory_and_ports () == -1)
         return -1;
@@ -367,11 +536,18 @@ clear_mode_X ()
 {
     int i;   /* loop index for checking memory fence */
     
+#if !defined(TEXT_RESTORE_PROGRAM)
+    /* Stop any redraw worker threads. */
+    stop_redraw_workers ();
+#endif
+
     /* Put VGA into text mode, restore font data, and clear screens. */
     set_text_mode_3 (1);
 
+#if !defined(REPLAY_PROGRAM)
     /* Unmap video memory. */
     (void)munmap (mem_image, VID_MEM_SIZE);
+#endif
 
     /* Check validity of build buffer memory fence.  Report breakage. */
     for (i = 0; i < MEM_FENCE_WIDTH; i++) {
@@ -506,11 +682,16 @@ set_view_window (int scr_x, int scr_y)
 /*
  * show_screen
  *   DESCRIPTION: Show the logical view window on the video display.
+ *                In PRESENT_TRIPLE mode, the image is copied into a page
+ *                that is neither on screen nor waiting to be latched; if
+ *                no such page exists (three flips without an observed
+ *                retrace), the frame is dropped rather than waiting.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: copies from the build buffer to video memory;
- *                 shifts the VGA display source to point to the new image
+ *                 shifts the VGA display source to point to the new image;
+ *                 updates presentation counters
  */   
 void
 show_screen ()
@@ -518,6 +699,32 @@ show_screen ()
     unsigned char* addr;  /* source address for copy             */
     int p_off;            /* plane offset of first display plane */
     int i;      /* loop index over video planes        */
+    int page;             /* page into which to copy the image   */
+
+    present_stats.frames++;
+
+    /* Learn whether the last flip has reached the monitor. */
+    update_flip_state ();
+
+    if (PRESENT_DOUBLE == present_mode) {
+	/* 
+	 * Switch to the other of the first two pages.  If the last flip
+	 * has not been latched, the page is probably still on screen.
+	 */
+	page = (-1 != flip_page ? flip_page : scan_page);
+	page = (1 == page ? 0 : 1);
+	if (-1 != flip_page)
+	    present_stats.torn++;
+    } else {
+	/* Find a page that cannot be on the monitor. */
+	for (page = 0; NUM_PAGES > page; page++)
+	    if (page != scan_page && page != flip_page && page != stale_page)
+		break;
+	if (NUM_PAGES == page) {
+	    present_stats.skipped++;
+	    return;
+	}
+    }
 
     /* 
      * Calculate offset of build buffer plane to be mapped into plane 0 
@@ -525,10 +732,6 @@ show_screen ()
      */
     p_off = (3 - (show_x & 3));
 
-    /* Switch to the other target screen in video memory. */
-    target_img ^= 0x4000;
-    //target_img ^= 0x4000
-
     /* Calculate the source address. */
     addr = img3 + (show_x >> 2) + show_y * SCROLL_X_WIDTH;
 
@@ -536,17 +739,50 @@ show_screen ()
     for (i = 0; i < 4; i++) {
   SET_WRITE_MASK (1 << (i + 8));
   copy_image (addr + ((p_off - i + 4) & 3) * SCROLL_SIZE + (p_off < i), 
-              target_img);
+              page_addr[page]);
     }
 
     /* 
      * Change the VGA registers to point the top left of the screen
      * to the video memory that we just filled.
      */
-    OUTW (0x03D4, (target_img & 0xFF00) | 0x0C);
-    OUTW (0x03D4, ((target_img & 0x00FF) << 8) | 0x0D);
+    flip_to_page (page);
 }
 
+
+/*
+ * set_present_mode
+ *   DESCRIPTION: Select double or triple buffering for show_screen.
+ *   INPUTS: mode -- PRESENT_DOUBLE or PRESENT_TRIPLE
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the pages used by later calls to show_screen
+ */   
+void
+set_present_mode (present_mode_t mode)
+{
+    present_mode = mode;
+}
+
+
+/*
+ * get_present_stats
+ *   DESCRIPTION: Read the frame presentation counters, which count frames,
+ *                flips, retraces observed, frames skipped (replaced before
+ *                reaching the monitor or dropped for lack of a free page),
+ *                and frames drawn into a page that may have been on screen.
+ *   INPUTS: none
+ *   OUTPUTS: stats -- the counters since set_mode_X
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */   
+void
+get_present_stats (present_stats_t* stats)
+{
+    *stats = present_stats;
+}
+
+
 ////////////////  THIS HELPER FUNCTION BELOW WRITTEN BY ME /////////////////////////////////////////////////
 /***
 *     this function is called from adventure.c. Here we use the buffer we write the font data to.  
@@ -560,6 +796,11 @@ print_status_bar (unsigned char * buffer)                     //takes buffer wit
 
   //text_to_graphics("HELLO", buffer);
 
+#if STATUS_BAR_TWO_COLOR
+  if (0 == status_bar_two_color (buffer))                       //two colors: fill four planes per write
+    return;
+#endif
+
   for (i = 0; i < 4; i++)                                         //loop over through the planes
   {
     SET_WRITE_MASK (1 << (i + 8));                                //here the set_write_mask 
@@ -567,6 +808,74 @@ print_status_bar (unsigned char * buffer)                     //takes buffer wit
   }    
 }
 
+
+/*
+ * status_bar_two_color
+ *   DESCRIPTION: Write a two-color status bar image to video memory using
+ *                the write mask.  The color of the first pixel is taken 
+ *                as the background and is written to all four planes at
+ *                once; then, for each combination of planes holding the
+ *                other color at an address, the write mask is set to 
+ *                that combination and those addresses written.  (The 
+ *                set/reset registers do not help: they expand each bit 
+ *                of the color to a whole byte of a plane.)
+ *   INPUTS: buf -- status bar image, by plane (as for print_status_bar)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, or -1 (with nothing written) if the 
+ *                 image has more than two colors
+ *   SIDE EFFECTS: writes the status bar in video memory; changes the
+ *                 write mask
+ */   
+static int
+status_bar_two_color (const unsigned char* buf)
+{
+    unsigned char planes[STATUS_BAR_ADDR_OFFSET]; /* planes with fg, by addr */
+    int used[16];       /* whether each plane combination occurs  */
+    unsigned char bg;   /* background color                       */
+    unsigned char fg;   /* text color (bg until one is found)     */
+    unsigned char c;    /* one pixel                              */
+    int i;              /* loop index over addresses              */
+    int p;              /* loop index over planes/combinations    */
+
+    /* Find the planes holding text pixels at each address. */
+    (void)memset (used, 0, sizeof (used));
+    bg = fg = buf[0];
+    for (i = 0; i < STATUS_BAR_ADDR_OFFSET; i++) {
+        planes[i] = 0;
+	for (p = 0; p < 4; p++) {
+	    c = buf[p * STATUS_BAR_ADDR_OFFSET + i];
+	    if (c == bg) {
+	        continue;
+	    }
+	    if (fg == bg) {
+	        fg = c;
+	    } else if (fg != c) {
+	        return -1;
+	    }
+	    planes[i] |= (1 << p);
+	}
+	used[planes[i]] = 1;
+    }
+
+    /* Fill the background in all four planes. */
+    SET_WRITE_MASK (0x0F00);
+    VMEM_FILL (0, bg, STATUS_BAR_ADDR_OFFSET);
+
+    /* Write the text pixels, one plane combination at a time. */
+    for (p = 1; p < 16; p++) {
+        if (!used[p]) {
+	    continue;
+	}
+	SET_WRITE_MASK (p << 8);
+	for (i = 0; i < STATUS_BAR_ADDR_OFFSET; i++) {
+	    if (planes[i] == p) {
+	        VMEM_FILL (i, fg, 1);
+	    }
+	}
+    }
+    return 0;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /*
@@ -584,7 +893,7 @@ clear_screens ()
     SET_WRITE_MASK (0x0F00);
 
     /* Set 64kB to zero (times four planes = 256kB). */
-    memset (mem_image, 0, MODE_X_MEM_SIZE);
+    VMEM_FILL (0, 0, MODE_X_MEM_SIZE);
 }
 
 
@@ -616,9 +925,8 @@ draw_vert_line (int x)
 {
   /* to be written... */
     unsigned char buf[IMAGE_Y_DIM];    /*memory of 200 pixels as defined in modex.h*/
-    unsigned char* addr;                /*address of first pixel in build*/
-    int p_off;                          /*offset of plane of first pixel*/
-    int i;                              /*loop index over pixels*/
+    pre_line_t* pre;                    /*prerendered image of line, if any*/
+    uint64_t t0, t1;                    /*timestamps for profiling*/
 
     /* Check whether requested line falls in the logical view window. */
     if (x < 0 || x >= SCROLL_X_DIM)
@@ -627,23 +935,25 @@ draw_vert_line (int x)
     /* Adjust x to the logical column value. */
     x += show_x;                                                //bring x to starting position
 
+    /* Use the prerendered image of the line if there is one. */
+    t0 = prof_now ();
+    if (NULL != (pre = find_prerendered (&pre_col[0][0], x, show_y, x))) {
+	copy_vert_line (x, pre->img);
+	pre->used = 1;
+	prerender_stats.used++;
+	prof_add (PHASE_PLANE_SPLIT, prof_now () - t0);
+	return 0;
+    }
+    prerender_stats.on_demand++;
+
     /* Get the image of the line. */
     (*vert_line_fn) (x, show_y, buf);
-
-    /* Calculate starting address in build buffer. */
-    addr = img3 + (x >> 2) + show_y * SCROLL_X_WIDTH;           //img3 gives the starting point
-                                                                //x >> 2 gives the plane offset
-                                                                //show_y * scroll_x_width gives total addresses
-    /* Calculate plane offset of first pixel. */
-    p_off = (3 - (x & 3));  
+    t1 = prof_now ();
+    prof_add (PHASE_LINE_FILL, t1 - t0);
 
     /* Copy image data into appropriate planes in build buffer. */
-    for (i = 0; i < SCROLL_Y_DIM; i++)                          //taking care of boundaries 
-    {                                                           //scroll_y_dim gives the length of the vert line 
-      addr[p_off * SCROLL_SIZE] = buf[i];                       //copy from buf into address
-      addr = addr + SCROLL_X_WIDTH;                             //increase address by one row of address to reach
-                                                                //a point directly below the current 'x' coordinate
-    }   
+    copy_vert_line (x, buf);
+    prof_add (PHASE_PLANE_SPLIT, prof_now () - t1);
     /* Return success. */
     return 0;
 }
@@ -666,10 +976,8 @@ int
 draw_horiz_line (int y)
 {
     unsigned char buf[SCROLL_X_DIM]; /* buffer for graphical image of line */
-    unsigned char* addr;             /* address of first pixel in build    */
-               /*     buffer (without plane offset)  */
-    int p_off;                       /* offset of plane of first pixel     */
-    int i;           /* loop index over pixels             */
+    pre_line_t* pre;                 /* prerendered image of line, if any  */
+    uint64_t t0, t1;                 /* timestamps for profiling           */
 
     /* Check whether requested line falls in the logical view window. */
     if (y < 0 || y >= SCROLL_Y_DIM)
@@ -678,8 +986,216 @@ draw_horiz_line (int y)
     /* Adjust y to the logical row value. */
     y += show_y;
 
+    /* Use the prerendered image of the line if there is one. */
+    t0 = prof_now ();
+    if (NULL != (pre = find_prerendered (&pre_row[0][0], show_x, y, y))) {
+	copy_horiz_line (y, pre->img);
+	pre->used = 1;
+	prerender_stats.used++;
+	prof_add (PHASE_PLANE_SPLIT, prof_now () - t0);
+	return 0;
+    }
+    prerender_stats.on_demand++;
+
     /* Get the image of the line. */
     (*horiz_line_fn) (show_x, y, buf);
+    t1 = prof_now ();
+    prof_add (PHASE_LINE_FILL, t1 - t0);
+
+    /* Copy image data into appropriate planes in build buffer. */
+    copy_horiz_line (y, buf);
+    prof_add (PHASE_PLANE_SPLIT, prof_now () - t1);
+
+    /* Return success. */
+    return 0;
+}
+
+
+/*
+ * draw_all_lines
+ *   DESCRIPTION: Draw every horizontal line of the logical view window 
+ *                into the build buffer, splitting the rows between the
+ *                calling thread and any redraw worker threads (see
+ *                set_redraw_threads).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the build buffer
+ */   
+void
+draw_all_lines ()
+{
+    uint64_t t0;  /* timestamp for profiling */
+    int n;        /* number of drawing threads */
+
+    t0 = prof_now ();
+    n = n_redraw_threads;
+    if (1 < n) {
+	/* Wake the workers. */
+	pthread_mutex_lock (&redraw_lock);
+	redraw_pending = n - 1;
+	redraw_gen++;
+	pthread_cond_broadcast (&redraw_start);
+	pthread_mutex_unlock (&redraw_lock);
+
+	/* Draw our own slice, then wait for the others. */
+	draw_rows (0, SCROLL_Y_DIM / n);
+	pthread_mutex_lock (&redraw_lock);
+	while (0 != redraw_pending) {
+	    pthread_cond_wait (&redraw_done, &redraw_lock);
+	}
+	pthread_mutex_unlock (&redraw_lock);
+    } else {
+	draw_rows (0, SCROLL_Y_DIM);
+    }
+    prof_add (PHASE_REDRAW, prof_now () - t0);
+}
+
+
+/*
+ * set_redraw_threads
+ *   DESCRIPTION: Set the number of threads used by draw_all_lines, 
+ *                starting or stopping worker threads as needed.  One
+ *                thread means that the caller draws all lines itself.
+ *                Must not be called while draw_all_lines is running.
+ *   INPUTS: n -- desired number of threads (including the caller)
+ *   OUTPUTS: none
+ *   RETURN VALUE: the number of threads now in use, which may be fewer
+ *                 than requested (at most MAX_REDRAW_THREADS, and fewer
+ *                 if a worker cannot be created)
+ *   SIDE EFFECTS: creates or joins threads
+ */   
+int
+set_redraw_threads (int n)
+{
+    int i;            /* index over worker threads          */
+    unsigned int gen; /* redraw_gen before any worker starts */
+
+    stop_redraw_workers ();
+    if (MAX_REDRAW_THREADS < n) {
+        n = MAX_REDRAW_THREADS;
+    }
+    pthread_mutex_lock (&redraw_lock);
+    redraw_quit = 0;
+    gen = redraw_gen;
+    pthread_mutex_unlock (&redraw_lock);
+    for (i = 1; n > i; i++) {
+	redraw_arg[i].id = i;
+	redraw_arg[i].gen = gen;
+	if (0 != pthread_create (&redraw_tid[i], NULL, redraw_worker, 
+				 &redraw_arg[i])) {
+	    break;
+	}
+    }
+
+    /* Workers read the thread count under the lock when woken. */
+    pthread_mutex_lock (&redraw_lock);
+    n_redraw_threads = i;
+    pthread_mutex_unlock (&redraw_lock);
+    return i;
+}
+
+
+/*
+ * prerender_lines
+ *   DESCRIPTION: Draw images of lines just outside the logical view window
+ *                that are not already prerendered, nearest lines first,
+ *                so that scrolling can copy them later (see draw_horiz_line
+ *                and draw_vert_line).  Lines outside the room are skipped.
+ *                Meant to be called repeatedly while otherwise idle; each
+ *                call is short.  Lines are not timed by the profiler.
+ *   INPUTS: n -- number of lines to draw (up to three more may be drawn)
+ *           (w,h) -- size of the room in pixels
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of lines drawn; 0 once all are prerendered
+ *   SIDE EFFECTS: may discard prerendered lines no longer near the window
+ */   
+int
+prerender_lines (int n, int w, int h)
+{
+    int d;         /* distance of lines from window */
+    int drawn = 0; /* number of lines drawn         */
+
+    for (d = 0; PRERENDER_LINES > d && n > drawn; d++) {
+	drawn += prerender_row (1, show_y + SCROLL_Y_DIM + d, h);
+	drawn += prerender_row (0, show_y - 1 - d, h);
+	drawn += prerender_col (1, show_x + SCROLL_X_DIM + d, w);
+	drawn += prerender_col (0, show_x - 1 - d, w);
+    }
+    return drawn;
+}
+
+
+/*
+ * discard_prerendered
+ *   DESCRIPTION: Discard prerendered lines with any pixel in a region of 
+ *                the room, which must be done whenever the region's image
+ *                changes (or for the whole room, when the room changes).
+ *   INPUTS: (x_lo,y_lo) -- upper left logical pixel of region
+ *           (x_hi,y_hi) -- one past the lower right logical pixel
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */   
+void
+discard_prerendered (int x_lo, int y_lo, int x_hi, int y_hi)
+{
+    int s; /* index over sides of window */
+    int i; /* index over lines           */
+    pre_line_t* line; /* a prerendered line */
+
+    for (s = 0; 2 > s; s++) {
+	for (i = 0; PRERENDER_LINES > i; i++) {
+	    line = &pre_row[s][i];
+	    if (y_lo <= line->y && y_hi > line->y && 
+		x_lo < line->x + SCROLL_X_DIM && x_hi > line->x) {
+		retire_prerendered (line);
+	    }
+	    line = &pre_col[s][i];
+	    if (x_lo <= line->x && x_hi > line->x && 
+		y_lo < line->y + SCROLL_Y_DIM && y_hi > line->y) {
+		retire_prerendered (line);
+	    }
+	}
+    }
+}
+
+
+/*
+ * get_prerender_stats
+ *   DESCRIPTION: Read the prerendered line counters, which count lines
+ *                prerendered, lines exposed by scrolling that were copied
+ *                from prerendered images or filled on demand, and 
+ *                prerendered lines discarded without being used.
+ *   INPUTS: none
+ *   OUTPUTS: stats -- the counters since the program started
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */   
+void
+get_prerender_stats (prerender_stats_t* stats)
+{
+    *stats = prerender_stats;
+}
+
+
+/*
+ * copy_horiz_line
+ *   DESCRIPTION: Copy the image of a horizontal line into the planes of
+ *                the build buffer.
+ *   INPUTS: y -- the logical row of the line (not relative to the window)
+ *           buf -- the image of the line, starting at show_x
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the build buffer
+ */   
+static void
+copy_horiz_line (int y, const unsigned char buf[SCROLL_X_DIM])
+{
+    unsigned char* addr;             /* address of first pixel in build    */
+               /*     buffer (without plane offset)  */
+    int p_off;                       /* offset of plane of first pixel     */
+    int i;           /* loop index over pixels             */
 
     /* Calculate starting address in build buffer. */
     addr = img3 + (show_x >> 2) + y * SCROLL_X_WIDTH;
@@ -695,9 +1211,243 @@ draw_horiz_line (int y)
       addr++;
   }
     }
+}
 
-    /* Return success. */
-    return 0;
+
+/*
+ * copy_vert_line
+ *   DESCRIPTION: Copy the image of a vertical line into the planes of
+ *                the build buffer.
+ *   INPUTS: x -- the logical column of the line (not relative to the window)
+ *           buf -- the image of the line, starting at show_y
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the build buffer
+ */   
+static void
+copy_vert_line (int x, const unsigned char buf[SCROLL_Y_DIM])
+{
+    unsigned char* addr;                /*address of first pixel in build*/
+    int p_off;                          /*offset of plane of first pixel*/
+    int i;                              /*loop index over pixels*/
+
+    /* Calculate starting address in build buffer. */
+    addr = img3 + (x >> 2) + show_y * SCROLL_X_WIDTH;           //img3 gives the starting point
+                                                                //x >> 2 gives the plane offset
+                                                                //show_y * scroll_x_width gives total addresses
+    /* Calculate plane offset of first pixel. */
+    p_off = (3 - (x & 3));  
+
+    /* Copy image data into appropriate planes in build buffer. */
+    for (i = 0; i < SCROLL_Y_DIM; i++)                          //taking care of boundaries 
+    {                                                           //scroll_y_dim gives the length of the vert line 
+      addr[p_off * SCROLL_SIZE] = buf[i];                       //copy from buf into address
+      addr = addr + SCROLL_X_WIDTH;                             //increase address by one row of address to reach
+                                                                //a point directly below the current 'x' coordinate
+    }   
+}
+
+
+/*
+ * draw_rows
+ *   DESCRIPTION: Draw a range of horizontal lines of the logical view 
+ *                window.  Unlike draw_horiz_line, does not record timing,
+ *                so it may run in several threads at once.
+ *   INPUTS: lo -- first row to draw (relative to the window)
+ *           hi -- one past the last row to draw
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the build buffer
+ */   
+static void
+draw_rows (int lo, int hi)
+{
+    unsigned char buf[SCROLL_X_DIM]; /* buffer for graphical image of line */
+    int y;                           /* loop index over rows               */
+
+    for (y = lo + show_y; hi + show_y > y; y++) {
+	(*horiz_line_fn) (show_x, y, buf);
+	copy_horiz_line (y, buf);
+    }
+}
+
+
+/*
+ * redraw_worker
+ *   DESCRIPTION: Function executed by redraw worker threads.  Waits for
+ *                draw_all_lines to start a redraw, draws this thread's
+ *                slice of the rows, and reports completion, until told 
+ *                to quit.
+ *   INPUTS: arg -- pointer to this worker's redraw_arg_t (slice index
+ *                  and starting generation)
+ *   OUTPUTS: none
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: draws into the build buffer
+ */   
+static void*
+redraw_worker (void* arg)
+{
+    const redraw_arg_t* ra = arg;  /* start-up arguments            */
+    int id = ra->id;               /* slice index                   */
+    unsigned int seen = ra->gen;   /* last redraw request handled   */
+    int n;                         /* number of slices this redraw  */
+
+    pthread_mutex_lock (&redraw_lock);
+    while (1) {
+	while (!redraw_quit && seen == redraw_gen) {
+	    pthread_cond_wait (&redraw_start, &redraw_lock);
+	}
+	if (redraw_quit) {
+	    break;
+	}
+	seen = redraw_gen;
+	n = n_redraw_threads;
+	pthread_mutex_unlock (&redraw_lock);
+
+	draw_rows (SCROLL_Y_DIM * id / n, SCROLL_Y_DIM * (id + 1) / n);
+
+	pthread_mutex_lock (&redraw_lock);
+	if (0 == --redraw_pending) {
+	    pthread_cond_signal (&redraw_done);
+	}
+    }
+    pthread_mutex_unlock (&redraw_lock);
+    return NULL;
+}
+
+
+/*
+ * stop_redraw_workers
+ *   DESCRIPTION: Stop and join all redraw worker threads.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: subsequent redraws use only the calling thread
+ */   
+static void
+stop_redraw_workers ()
+{
+    int i; /* index over worker threads */
+
+    if (1 == n_redraw_threads) {
+        return;
+    }
+    pthread_mutex_lock (&redraw_lock);
+    redraw_quit = 1;
+    pthread_cond_broadcast (&redraw_start);
+    pthread_mutex_unlock (&redraw_lock);
+    for (i = 1; n_redraw_threads > i; i++) {
+	(void)pthread_join (redraw_tid[i], NULL);
+    }
+    n_redraw_threads = 1;
+}
+
+
+/*
+ * find_prerendered
+ *   DESCRIPTION: Find a prerendered line on either side of the window.
+ *   INPUTS: side -- the first of the two sides' slots (pre_row or pre_col)
+ *           (x,y) -- logical position of the line's first pixel
+ *           key -- the line's logical coordinate (y for rows, x for 
+ *                  columns), which selects its slot
+ *   OUTPUTS: none
+ *   RETURN VALUE: the line, or NULL if it has not been prerendered
+ *   SIDE EFFECTS: none
+ */   
+static pre_line_t*
+find_prerendered (pre_line_t* side, int x, int y, int key)
+{
+    int s;            /* index over sides of window */
+    pre_line_t* line; /* candidate line             */
+
+    for (s = 0; 2 > s; s++) {
+	line = &side[s * PRERENDER_LINES + (key & (PRERENDER_LINES - 1))];
+	if (line->valid && x == line->x && y == line->y) {
+	    return line;
+	}
+    }
+    return NULL;
+}
+
+
+/*
+ * retire_prerendered
+ *   DESCRIPTION: Empty a prerendered line's slot, counting the line as
+ *                wasted if it was never used.
+ *   INPUTS: line -- the slot
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */   
+static void
+retire_prerendered (pre_line_t* line)
+{
+    if (line->valid && !line->used) {
+        prerender_stats.wasted++;
+    }
+    line->valid = 0;
+}
+
+
+/*
+ * prerender_row
+ *   DESCRIPTION: Prerender a row outside the window starting at show_x, 
+ *                unless it is outside the room or already prerendered.
+ *   INPUTS: s -- side of window (0 above, 1 below)
+ *           y -- logical row
+ *           h -- height of the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the row was drawn, 0 if not
+ *   SIDE EFFECTS: replaces the line in the row's slot
+ */   
+static int
+prerender_row (int s, int y, int h)
+{
+    pre_line_t* line = &pre_row[s][y & (PRERENDER_LINES - 1)];
+
+    if (0 > y || h <= y ||
+	(line->valid && show_x == line->x && y == line->y)) {
+        return 0;
+    }
+    retire_prerendered (line);
+    (*horiz_line_fn) (show_x, y, line->img);
+    line->valid = 1;
+    line->used = 0;
+    line->x = show_x;
+    line->y = y;
+    prerender_stats.drawn++;
+    return 1;
+}
+
+
+/*
+ * prerender_col
+ *   DESCRIPTION: Prerender a column outside the window starting at show_y,
+ *                unless it is outside the room or already prerendered.
+ *   INPUTS: s -- side of window (0 left, 1 right)
+ *           x -- logical column
+ *           w -- width of the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the column was drawn, 0 if not
+ *   SIDE EFFECTS: replaces the line in the column's slot
+ */   
+static int
+prerender_col (int s, int x, int w)
+{
+    pre_line_t* line = &pre_col[s][x & (PRERENDER_LINES - 1)];
+
+    if (0 > x || w <= x ||
+	(line->valid && x == line->x && show_y == line->y)) {
+        return 0;
+    }
+    retire_prerendered (line);
+    (*vert_line_fn) (x, show_y, line->img);
+    line->valid = 1;
+    line->used = 0;
+    line->x = x;
+    line->y = show_y;
+    prerender_stats.drawn++;
+    return 1;
 }
 
 #endif /* !defined(TEXT_RESTORE_PROGRAM) */
@@ -715,6 +1465,11 @@ draw_horiz_line (int y)
 static int
 open_memory_and_ports ()
 {
+#if defined(REPLAY_PROGRAM)
+    /* Use the emulated VGA instead. */
+    vga_reset ();
+    return 0;
+#else
     int mem_fd;  /* file descriptor for physical memory image */
 
     /* Obtain permission to access ports 0x03C0 through 0x03DA. */
@@ -739,6 +1494,7 @@ open_memory_and_ports ()
     /* Close /dev/mem file descriptor and return success. */
     (void)close (mem_fd);
     return 0;
+#endif
 }
 
 
@@ -759,6 +1515,7 @@ VGA_blank (int blank_bit)
      */
     blank_bit = ((blank_bit & 1) << 5);
 
+#if !defined(REPLAY_PROGRAM)
     asm volatile (
   "movb $0x01,%%al         /* Set sequencer index to 1. */       ;"
   "movw $0x03C4,%%dx                                             ;"
@@ -774,6 +1531,7 @@ VGA_blank (int blank_bit)
   "movb $0x20,%%al                                               ;"
   "outb %%al,(%%dx)                                               "
       : : "g" (blank_bit) : "eax", "edx", "memory");
+#endif
 }
 
 
@@ -845,9 +1603,11 @@ static void
 set_attr_registers (unsigned char table[NUM_ATTR_REGS * 2])
 {
     /* Reset attribute register to write index next rather than data. */
+#if !defined(REPLAY_PROGRAM)
     asm volatile (
   "inb (%%dx),%%al"
       : : "d" (0x03DA) : "eax", "memory");
+#endif
     REP_OUTSB (0x03C0, table, NUM_ATTR_REGS * 2);
 }
 
@@ -1014,7 +1774,7 @@ write_font_data ()
 static void
 set_text_mode_3 (int clear_scr)
 {
-    unsigned long* txt_scr; /* pointer to text screens in video memory */
+    uint32_t* txt_scr;      /* pointer to text screens in video memory */
     int i;                  /* loop over text screen words             */
 
     VGA_blank (1);                               /* blank the screen        */
@@ -1029,7 +1789,7 @@ set_text_mode_3 (int clear_scr)
     set_graphics_registers (text_graphics);      /* graphics registers      */
     fill_palette_text ();      /* palette colors          */
     if (clear_scr) {         /* clear screens if needed */
-  txt_scr = (unsigned long*)(mem_image + 0x18000); 
+  txt_scr = (uint32_t*)(mem_image + 0x18000); 
   for (i = 0; i < 8192; i++)
       *txt_scr++ = 0x07200720;
     }
@@ -1056,6 +1816,9 @@ copy_image (unsigned char* img, unsigned short scr_addr)
      * implemented using ISA-specific features like those below,
      * but the code here provides an example of x86 string moves
      */
+#if defined(REPLAY_PROGRAM)
+    vga_write (scr_addr, img, 16000);
+#else
     asm volatile (
         "cld                                                 ;"
         "movl $16000,%%ecx                                   ;"
@@ -1064,6 +1827,104 @@ copy_image (unsigned char* img, unsigned short scr_addr)
       : "S" (img), "D" (mem_image + scr_addr) 
       : "eax", "ecx", "memory"
     );
+#endif
+}
+
+/*
+ * vga_in_vretrace
+ *   DESCRIPTION: Poll the VGA input status register (0x3DA) for vertical
+ *                retrace.  Reading the register also resets the attribute
+ *                controller flip-flop, which we never leave in data state.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the VGA is in vertical retrace, 0 if not
+ *   SIDE EFFECTS: none
+ */   
+static int
+vga_in_vretrace ()
+{
+    unsigned char status; /* input status register #1 */
+
+    INB (0x03DA, status);
+    return (0 != (status & 0x08));
+}
+
+
+/*
+ * update_flip_state
+ *   DESCRIPTION: Decide whether the most recent flip has been latched by
+ *                the VGA.  A flip is latched once a vertical retrace starts
+ *                after the start address was written: we know that either
+ *                by seeing the display leave and re-enter retrace, or by
+ *                two refresh periods passing since the write.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may update scan_page, flip_page, and stale_page
+ */   
+static void
+update_flip_state ()
+{
+    struct timespec now; /* current time                      */
+    long elapsed;        /* nanoseconds since last flip write */
+
+    if (-1 == flip_page)
+        return;
+
+    if (vga_in_vretrace ()) {
+	/* A retrace seen after the display left retrace latched the flip. */
+        if (flip_armed) {
+	    present_stats.retraces++;
+	    scan_page = flip_page;
+	    flip_page = stale_page = -1;
+	    return;
+	}
+    } else {
+        flip_armed = 1;
+    }
+
+    /* Otherwise, fall back on the time since the flip was written. */
+    (void)clock_gettime (CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - flip_time.tv_sec) * 1000000000L +
+	      (now.tv_nsec - flip_time.tv_nsec);
+    if (2 * VGA_FRAME_NSEC <= elapsed) {
+	scan_page = flip_page;
+	flip_page = stale_page = -1;
+    }
+}
+
+
+/*
+ * flip_to_page
+ *   DESCRIPTION: Point the VGA display start address at a page.  The VGA
+ *                latches the new address at the next vertical retrace.
+ *   INPUTS: page -- index of the page to show
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes CRTC registers; updates page flipping state
+ */   
+static void
+flip_to_page (int page)
+{
+    unsigned short addr = page_addr[page]; /* new display start address */
+
+    /* A frame still waiting for the retrace never reaches the monitor. */
+    if (-1 != flip_page) {
+        if (PRESENT_TRIPLE == present_mode) {
+	    present_stats.skipped++;
+	    stale_page = flip_page;
+	} else {
+	    scan_page = flip_page;
+	}
+    }
+
+    OUTW (0x03D4, (addr & 0xFF00) | 0x0C);
+    OUTW (0x03D4, ((addr & 0x00FF) << 8) | 0x0D);
+    present_stats.flips++;
+
+    flip_page = page;
+    flip_armed = !vga_in_vretrace ();
+    (void)clock_gettime (CLOCK_MONOTONIC, &flip_time);
 }
 
 void
@@ -1100,6 +1961,9 @@ copy_image2 (unsigned char* img, unsigned short scr_addr)               //this f
      * implemented using ISA-specific features like those below,
      * but the code here provides an example of x86 string moves
      */
+#if defined(REPLAY_PROGRAM)
+    vga_write (scr_addr, img, 1440);
+#else
     asm volatile (
         "cld                                                 ;"       //we have a combination of x86 and c
         "movl $1440,%%ecx                                   ;"        //to store into ecx and eax
@@ -1108,9 +1972,220 @@ copy_image2 (unsigned char* img, unsigned short scr_addr)               //this f
       : "S" (img), "D" (mem_image + scr_addr)                         //finally send to memory
       : "eax", "ecx", "memory"                                        //which prints
     );
+#endif
 }
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#if defined(REPLAY_PROGRAM)
+
+/*
+ * State of the emulated VGA used by the replay program: four planes of
+ * 64kB, the CPU's window onto video memory (used only by text mode), 
+ * the register indices last selected, the write mask, the display start
+ * address, and the palette.  vga_status_reads counts reads of the input
+ * status register since the start address was last written (see 
+ * vga_inb).
+ */
+static unsigned char vga_plane[4][MODE_X_MEM_SIZE];
+static unsigned char vga_window[VID_MEM_SIZE];
+static unsigned char vga_seq_index, vga_crtc_index;
+static unsigned char vga_write_mask;
+static unsigned short vga_start;
+static unsigned char vga_dac[256][3];
+static unsigned int vga_dac_pos;       /* 3 * color + component */
+static unsigned int vga_status_reads;
+
+
+/*
+ * vga_reset
+ *   DESCRIPTION: Reset the emulated VGA: clear video memory and palette.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: points mem_image at the emulated video memory window
+ */   
+static void
+vga_reset ()
+{
+    memset (vga_plane, 0, sizeof (vga_plane));
+    memset (vga_dac, 0, sizeof (vga_dac));
+    vga_seq_index = vga_crtc_index = 0;
+    vga_write_mask = 0x0F;
+    vga_start = 0;
+    vga_dac_pos = 0;
+    vga_status_reads = 0;
+    mem_image = vga_window;
+}
+
+
+/*
+ * vga_outb
+ *   DESCRIPTION: Write a byte to an emulated VGA port.
+ *   INPUTS: port -- the port
+ *           val -- the value written
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes emulated VGA registers
+ */   
+static void
+vga_outb (unsigned short port, unsigned char val)
+{
+    switch (port) {
+        case 0x03C4: vga_seq_index = val; break;
+	case 0x03C5:
+	    if (0x02 == vga_seq_index)
+	        vga_write_mask = (val & 0x0F);
+	    break;
+	case 0x03C8: vga_dac_pos = 3 * val; break;
+	case 0x03C9:
+	    vga_dac[(vga_dac_pos / 3) & 0xFF][vga_dac_pos % 3] = (val & 0x3F);
+	    vga_dac_pos++;
+	    break;
+	case 0x03D4: vga_crtc_index = val; break;
+	case 0x03D5:
+	    if (0x0C == vga_crtc_index) {
+	        vga_start = (vga_start & 0x00FF) | (val << 8);
+		vga_status_reads = 0;
+	    } else if (0x0D == vga_crtc_index) {
+	        vga_start = (vga_start & 0xFF00) | val;
+		vga_status_reads = 0;
+	    }
+	    break;
+    }
+}
+
+
+/*
+ * vga_outw
+ *   DESCRIPTION: Write two bytes to two consecutive emulated VGA ports.
+ *   INPUTS: port -- the first port
+ *           val -- the values written (low byte to port)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes emulated VGA registers
+ */   
+static void
+vga_outw (unsigned short port, unsigned short val)
+{
+    vga_outb (port, val & 0xFF);
+    vga_outb (port + 1, val >> 8);
+}
+
+
+/*
+ * vga_inb
+ *   DESCRIPTION: Read a byte from an emulated VGA port.  Only the input 
+ *                status register (0x3DA) is modeled: after each start
+ *                address write, the display is first seen outside of 
+ *                vertical retrace, then in retrace, alternately, so every
+ *                flip is latched before the next frame.
+ *   INPUTS: port -- the port
+ *   OUTPUTS: none
+ *   RETURN VALUE: the value read
+ *   SIDE EFFECTS: advances the emulated retrace
+ */   
+static unsigned char
+vga_inb (unsigned short port)
+{
+    if (0x03DA != port)
+        return 0;
+    return ((vga_status_reads++ & 1) ? 0x08 : 0x00);
+}
+
+
+/*
+ * vga_write
+ *   DESCRIPTION: Copy data into emulated video memory, in each plane 
+ *                enabled by the write mask.
+ *   INPUTS: addr -- the destination offset in video memory
+ *           src -- the data
+ *           n -- number of bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes emulated video memory (clipped to 64kB)
+ */   
+static void
+vga_write (unsigned int addr, const unsigned char* src, int n)
+{
+    int p; /* loop index over planes */
+
+    if (addr >= MODE_X_MEM_SIZE)
+        return;
+    if (n > MODE_X_MEM_SIZE - addr)
+        n = MODE_X_MEM_SIZE - addr;
+    for (p = 0; p < 4; p++)
+        if (vga_write_mask & (1 << p))
+	    memcpy (&vga_plane[p][addr], src, n);
+}
+
+
+/*
+ * vga_fill
+ *   DESCRIPTION: Fill emulated video memory with a value, in each plane 
+ *                enabled by the write mask.
+ *   INPUTS: addr -- the destination offset in video memory
+ *           val -- the value
+ *           n -- number of bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes emulated video memory (clipped to 64kB)
+ */   
+static void
+vga_fill (unsigned int addr, unsigned char val, int n)
+{
+    int p; /* loop index over planes */
+
+    if (addr >= MODE_X_MEM_SIZE)
+        return;
+    if (n > MODE_X_MEM_SIZE - addr)
+        n = MODE_X_MEM_SIZE - addr;
+    for (p = 0; p < 4; p++)
+        if (vga_write_mask & (1 << p))
+	    memset (&vga_plane[p][addr], val, n);
+}
+
+
+/*
+ * vga_frame_hash
+ *   DESCRIPTION: Hash the picture that the emulated VGA displays: the 
+ *                status bar and the page at the display start address, 
+ *                pixel by pixel in scan order, then the palette (64-bit
+ *                FNV-1a).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the hash
+ *   SIDE EFFECTS: none
+ */   
+uint64_t
+vga_frame_hash ()
+{
+    uint64_t h = 0xCBF29CE484222325ULL; /* hash so far              */
+    unsigned int base;                  /* address of top row       */
+    int rows;                           /* rows in region           */
+    int r;                              /* loop index over regions  */
+    int y, x;                           /* loop indices over pixels */
+    int c;                              /* loop index over palette  */
+
+    for (r = 0; r < 2; r++) {
+        base = (0 == r ? 0 : vga_start);
+	rows = (0 == r ? STATUS_BAR_ADDR_OFFSET / IMAGE_X_WIDTH : IMAGE_Y_DIM);
+	for (y = 0; y < rows; y++) {
+	    for (x = 0; x < IMAGE_X_DIM; x++) {
+	        h ^= vga_plane[x & 3][(base + y * IMAGE_X_WIDTH + (x >> 2)) &
+				       (MODE_X_MEM_SIZE - 1)];
+		h *= 0x100000001B3ULL;
+	    }
+	}
+    }
+    for (c = 0; c < 256 * 3; c++) {
+        h ^= vga_dac[c / 3][c % 3];
+	h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+#endif /* defined(REPLAY_PROGRAM) */
+
 #if defined(TEXT_RESTORE_PROGRAM)
 
 /*
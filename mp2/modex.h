@@ -41,6 +41,8 @@
 #define MODEX_H
 
 
+#include <stdint.h>
+
 #include "text.h"
 
 
@@ -110,8 +112,49 @@
  * within a logical space defined by the program.  For example, if this
  * window shifts one pixel to the left, only the left border of the screen
  * is drawn.  Other data are left untouched in most cases.
+ *
+ * Presentation can use either two or three pages of video memory.  With
+ * two pages, show_screen always overwrites the page that was shown before
+ * the most recent flip, which may still be on the monitor if the VGA has
+ * not yet latched the new start address (at the next vertical retrace).
+ * With three pages, show_screen picks a page that is neither on screen nor
+ * waiting for the retrace, so it never draws into the visible image and
+ * never waits for the retrace either.  The VGA retrace status (0x3DA) is
+ * polled (never waited upon) to learn when a flip has taken effect.
+ */
+
+/* page flipping strategies used by show_screen */
+typedef enum {
+    PRESENT_DOUBLE,  /* two pages, flip immediately (may tear)          */
+    PRESENT_TRIPLE   /* three pages, never draw into a page on screen   */
+} present_mode_t;
+
+/* frame presentation counters (see get_present_stats) */
+typedef struct present_stats_t present_stats_t;
+struct present_stats_t {
+    unsigned long frames;   /* calls to show_screen                        */
+    unsigned long flips;    /* display start address changes               */
+    unsigned long retraces; /* flips confirmed by polling the retrace bit  */
+    unsigned long skipped;  /* frames replaced or dropped before scan-out  */
+    unsigned long torn;     /* frames drawn into a page possibly on screen */
+};
+
+/*
+ * Lines just outside the logical view window can be prerendered while the
+ * caller is otherwise idle (see prerender_lines).  When a scroll exposes
+ * a prerendered line, draw_horiz_line or draw_vert_line copies the saved
+ * image rather than calling the line fill function.
  */
 
+/* prerendered line counters (see get_prerender_stats) */
+typedef struct prerender_stats_t prerender_stats_t;
+struct prerender_stats_t {
+    unsigned long drawn;     /* lines prerendered                          */
+    unsigned long used;      /* scrolled-in lines copied from prerendering */
+    unsigned long wasted;    /* prerendered lines discarded before use     */
+    unsigned long on_demand; /* scrolled-in lines filled when needed       */
+};
+
 /* configure VGA for mode X; initializes logical view to (0,0) */
 extern int set_mode_X (void (*horiz_fill_fn)
                             (int, int, unsigned char[SCROLL_X_DIM]),
@@ -127,6 +170,12 @@ extern void set_view_window (int scr_x, int scr_y);
 /* show the logical view window on the monitor */
 extern void show_screen ();
 
+/* select double or triple buffering for show_screen */
+extern void set_present_mode (present_mode_t mode);
+
+/* read the frame presentation counters */
+extern void get_present_stats (present_stats_t* stats);
+
 /* clear the video memory in mode X */
 extern void clear_screens ();
 
@@ -136,9 +185,29 @@ extern int draw_horiz_line (int y);
 /* draw a vertical line at horizontal pixel x within the logical view window */
 extern int draw_vert_line (int x);
 
+/* draw all lines of the logical view window (in parallel, if enabled) */
+extern void draw_all_lines ();
+
+/* set number of threads used by draw_all_lines; returns number in use */
+extern int set_redraw_threads (int n);
+
+/* prerender about n lines around the view in a w x h room; returns number */
+extern int prerender_lines (int n, int w, int h);
+
+/* discard prerendered lines touching a region (in logical coordinates) */
+extern void discard_prerendered (int x_lo, int y_lo, int x_hi, int y_hi);
+
+/* read the prerendered line counters */
+extern void get_prerender_stats (prerender_stats_t* stats);
+
 // HELPER FUNCTION WRITTEN BY ME
 extern void print_status_bar(unsigned char * buf);
 
 void palette_print(unsigned int i, unsigned char red, unsigned char green, unsigned char blue);
 
+#if defined(REPLAY_PROGRAM)
+/* hash the picture shown by the emulated VGA (replay program only) */
+extern uint64_t vga_frame_hash ();
+#endif
+
 #endif /* MODEX_H */
@@ -20,7 +20,11 @@
 #include <linux/miscdevice.h>
 #include <linux/kdev_t.h>
 #include <linux/tty.h>
-#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/ktime.h>
+#include <asm/system.h>
 
 #include "tuxctl-ld.h"
 #include "tuxctl-ioctl.h"
@@ -30,6 +34,7 @@
 	printk(KERN_DEBUG "%s: " str, __FUNCTION__, ## __VA_ARGS__)
 
 #define led_size_buf 6
+#define event_queue_size 64		//button events queued for read(); must be a power of two
 /************************ Protocol Implementation *************************/
 
 /* tuxctl_handle_packet()
@@ -66,17 +71,33 @@ volatile int poll_type = 0; 		//1 would indicate  that the button is polled and
 ************************************************************************************************/
 volatile char led_regular_buffer[led_size_buf] = {0, 0, 0, 0, 0, 0};		//stores led value which is send to tux to indicate which led should go on
 volatile char regular_buffer[2];								//Used as a temporary buffer to parse 2nd(b) and 3rd(c) byte of packets going from TUX to the PC 
-volatile char button_buffer[2];									//stores button values which parses incoming packets from TUX and maps it to what the PC should do
 int previous_led_status = 0;									//keeps a track if the led was on so as to know if that has to be checked or not
 
 
-/***************************  LOCKS WHICH ARE USED THROUGHTOUT THE CODE  ****************************************
- *																												*	 
- *	This locks the incoming packets together as we don't want interrupts when we read the packets and parse it.	*
- *	If no locks then we might be sending error messages when we might be generating interrupts from the TUX 	*
- *	and as a result our code will keep trying to send packets and resend them. 									*		
-****************************************************************************************************************/	
-spinlock_t lock = SPIN_LOCK_UNLOCKED;							//This is a lock declaration in which we lock segments of code which have to be carried out together without any interruptions.
+/***************************  BUTTON EVENT QUEUE  **************************************************************
+ *																												*
+ *	Each MTCP_BIOC_EVENT packet that changes the buttons is queued, stamped with its arrival time, for read()	*
+ *	to hand to the game, so that no press or release is missed however briefly a button is held.				*
+ *																												*
+ *	The queue is a single-producer, single-consumer ring, so packet parsing takes no lock and never disables	*
+ *	interrupts.  The receive path (tuxctl_handle_packet) is the only producer and the only writer of			*
+ *	event_head; the read path is the only consumer and the only writer of event_tail.  Both count events		*
+ *	(they wrap).  The producer fills a slot before publishing it with smp_wmb(); the consumer reads a slot		*
+ *	after smp_rmb() and frees it only after smp_mb(), so the producer never overwrites a slot being read.		*
+ *	Readers (read() and TUX_INIT) are serialized by read_mutex, which sleeps rather than spins.					*
+ *	If the queue is full, the change is dropped and counted in events_lost; last_buttons is then left alone,	*
+ *	so the next event queued still reports every button changed since the last one queued.						*
+ *	TUX_BUTTONS reads current_buttons, which is a single byte and so is always read whole.						*
+ *	Readers sleep on event_wait until an event arrives.															*
+****************************************************************************************************************/
+static struct tux_event event_queue[event_queue_size];
+static volatile unsigned event_head = 0;						//events queued (written by producer only)
+static volatile unsigned event_tail = 0;						//events read (written by consumer only)
+static volatile unsigned long events_lost = 0;					//changes dropped on a full queue (producer only)
+static unsigned char last_buttons = 0xFF;						//buttons in the newest event (producer only; active low: none held)
+static volatile unsigned char current_buttons = 0xFF;			//buttons held now, for TUX_BUTTONS (producer only)
+static DEFINE_MUTEX(read_mutex);
+static DECLARE_WAIT_QUEUE_HEAD(event_wait);
 
 char nums[16] = {0xE7, 0x06, 0xCB, 0x8F, 0x2E, 0xAD, 0xED, 0x86, 0xEF, 0xAE, 0xEE, 0x6D, 0xE1, 0x4F, 0xE9, 0xE8};
 //				  0	    1     2     3     4     5     6     7     8     9     10    11    12    13    14    15
@@ -84,15 +105,13 @@ char nums[16] = {0xE7, 0x06, 0xCB, 0x8F, 0x2E, 0xAD, 0xED, 0x86, 0xEF, 0xAE, 0xE
 /*	THE HELPER FUNCTIONS WHICH ARE USED TO HANDLE SMALL TASKS IN PARSING PACKETS */
 void process_rcvd_pckt0(unsigned a, unsigned b, unsigned c);	//will check 1st packet received from TUX, parse it, and store in a temp buffer which we can read
 void process_rcvd_pckt1(unsigned a, unsigned b, unsigned c);	//will check 2nd packet received from TUX, parse it, and store in a temp buffer which we can read
+static void queue_button_event(unsigned char buttons);			//queues a button change for read() (receive path only)
 
 
 void tuxctl_handle_packet (struct tty_struct* tty, unsigned char* packet)
 {
     unsigned a, b, c;												//indicate 1st, 2nd, and 3rd bytes of received packets
-	unsigned long irq;												//used in the lock which will lock packet manipulation.
 
-	spin_lock_irqsave(&lock, irq);									//we start the lock here which will continue till the end of packet manipulation 
-	
     a = packet[0]; 													
     b = packet[1]; 													//store packet 0,1,2 from incoming packet
     c = packet[2];													
@@ -123,8 +142,7 @@ void tuxctl_handle_packet (struct tty_struct* tty, unsigned char* packet)
     	/*	This case is used for buttons	*/
     	case MTCP_BIOC_EVENT:										//Generated when the Button Interrupt-on-change mode is enabled and a button is either pressed or released.
     	{	
-			button_buffer[0] = b;									
-			button_buffer[1] = c;    								//store value for 3rd byte in the buffer dedicated to buttons
+			queue_button_event((b & 0x0F) | ((c & 0x0F) << 4));	//low 4 bits of 2nd and 3rd bytes, as TUX_BUTTONS reports them
 			break;
     	}
 
@@ -175,14 +193,100 @@ void tuxctl_handle_packet (struct tty_struct* tty, unsigned char* packet)
 	a = 0x00;
 	b = 0x00;
 	c = 0x00;
-////////////////////////////////////////////////////////////////////
-////////	IMPLEMENTING LOCKS 	////////////////////////////////////
-	spin_unlock_irqrestore(&lock, irq);
-////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////
     return;
 }
 
+/* queue_button_event()
+ * Record the buttons held and queue a change in them, stamped with the
+ * current time, then wake any reader.  Packets that repeat the buttons
+ * last queued are ignored.  If the queue is full, the change is dropped
+ * and counted.  Called only from tuxctl_handle_packet() (the producer;
+ * in interrupt context).
+ */
+static void queue_button_event(unsigned char buttons)
+{
+	struct tux_event *ev;
+	unsigned head = event_head;
+
+	current_buttons = buttons;
+	if(buttons == last_buttons)
+		return;
+	if(event_queue_size == head - event_tail)
+	{
+		events_lost++;
+		return;
+	}
+	smp_mb();													//consumer is done with the slot (pairs with its smp_mb)
+	ev = &event_queue[head & (event_queue_size - 1)];
+	memset(ev, 0, sizeof(*ev));
+	ev->time_ns = ktime_to_ns(ktime_get());						//monotonic, like CLOCK_MONOTONIC in user space
+	ev->buttons = buttons;
+	ev->changed = buttons ^ last_buttons;
+	smp_wmb();													//fill the slot before publishing it
+	event_head = head + 1;
+	last_buttons = buttons;
+	wake_up_interruptible(&event_wait);
+}
+
+/* tuxctl_read()
+ * The read() method of the line discipline: copy as many whole queued
+ * button events (struct tux_event) as fit in the buffer.  Blocks until an
+ * event arrives unless the file is non-blocking.  Returns the number of
+ * bytes copied, -EINVAL if the buffer cannot hold an event, -EAGAIN if
+ * none is queued and the file is non-blocking, or -EFAULT if the buffer
+ * is bad.
+ */
+ssize_t tuxctl_read(struct tty_struct *tty, struct file *file,
+		    unsigned char __user *buf, size_t nr)
+{
+	struct tux_event ev;
+	unsigned tail;
+	ssize_t done = 0;
+
+	if(nr < sizeof(ev))
+		return -EINVAL;
+	if(mutex_lock_interruptible(&read_mutex))
+		return -ERESTARTSYS;
+	while(event_head == event_tail)
+	{
+		mutex_unlock(&read_mutex);
+		if(file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if(wait_event_interruptible(event_wait, event_head != event_tail))
+			return -ERESTARTSYS;
+		if(mutex_lock_interruptible(&read_mutex))
+			return -ERESTARTSYS;
+	}
+	tail = event_tail;
+	while(nr - done >= sizeof(ev) && event_head != tail)
+	{
+		smp_rmb();												//read the slot only after seeing it published
+		ev = event_queue[tail & (event_queue_size - 1)];
+		smp_mb();												//finish reading the slot before freeing it
+		event_tail = ++tail;
+
+		if(copy_to_user(buf + done, &ev, sizeof(ev)))
+		{
+			done = (0 < done ? done : -EFAULT);
+			break;
+		}
+		done += sizeof(ev);
+	}
+	mutex_unlock(&read_mutex);
+	return done;
+}
+
+/* tuxctl_poll()
+ * The poll() method of the line discipline: the port is readable while
+ * any button event is queued.
+ */
+unsigned int tuxctl_poll(struct tty_struct *tty, struct file *file,
+			 poll_table *wait)
+{
+	poll_wait(file, &event_wait, wait);
+	return (event_head != event_tail ? POLLIN | POLLRDNORM : 0);
+}
+
 void process_rcvd_pckt0(unsigned a, unsigned b, unsigned c)
 {
 	switch(a)
@@ -288,6 +392,11 @@ tuxctl_ioctl (struct tty_struct* tty, struct file* file,
 		case TUX_INIT: 													// Initializes variables which are given in mtcp.h
 		{
 			char regular_buf_one[1];									//temporary buffer used only here. Buffer had to be created to pass in same format in tuxctl_ldisc_put() function
+
+			mutex_lock(&read_mutex);									//empty the button event queue (as its consumer)
+			event_tail = event_head;
+			mutex_unlock(&read_mutex);
+
 			regular_buf_one[0] = MTCP_BIOC_ON;		
 			tuxctl_ldisc_put(tty, regular_buf_one, 1);					//return bioc value
 
@@ -315,13 +424,8 @@ tuxctl_ioctl (struct tty_struct* tty, struct file* file,
 		
 		case TUX_BUTTONS:
 		{
-			int int_ptr = 0x00000000;
-			char a, b;
-			a = button_buffer[0];
-			b = button_buffer[1];
+			int int_ptr = current_buttons;								//one byte, set whole by the receive path: no lock needed
 			
-			int_ptr = (int_ptr | (a & 0x0F));							//we use the last 4 values of the reveived packet(1) for buttons
-			int_ptr = (int_ptr | ((b & 0x0F)<<4));						//we use the last 4 values of the reveived packet(2) for buttons. We have to mask it to get all 8 values in one integer
 			ret_val = copy_to_user((int *)arg, &int_ptr, 4);			//We have to copy from kernel space to user space to copy button values from kernel so that they can mapped in the PC
 			
 			if(ret_val>0)												//If the number of bytes copied from kernal space to user space are > 0 then there was an error
@@ -331,6 +435,25 @@ tuxctl_ioctl (struct tty_struct* tty, struct file* file,
 		}
 		
 		
+/***************  TUX_LOST_EVENTS ***********************************************
+*																				*
+*	Takes a pointer to an unsigned long. Returns -EINVAL error if this			*
+*	pointer is not valid. Otherwise, stores the number of button changes		*
+*	dropped because the event queue was full.									*
+*																				*
+********************************************************************************/
+
+		case TUX_LOST_EVENTS:
+		{
+			unsigned long lost = events_lost;
+			
+			if(copy_to_user((unsigned long *)arg, &lost, sizeof(lost)))
+				return -EINVAL;
+			ret_val = 0;
+			break;
+		}
+
+
 /******************* TUX_SET_LED **********************************************
  *                                                                            *
  * 	The argument is a 32-bit integer of the following form: The low 16-bits   *
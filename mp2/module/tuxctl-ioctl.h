@@ -9,6 +9,24 @@
 #define TUX_READ_LED _IOW('E', 0x11, unsigned long*)
 #define TUX_LED_REQUEST _IO('E', 0x14)
 #define TUX_LED_ACK _IO('E', 0x15)
+#define TUX_LOST_EVENTS _IOW('E', 0x16, unsigned long*)
+
+/*
+ * A change in the buttons held down, as read from the Tux controller's
+ * serial port.  The driver queues one for each MTCP_BIOC_EVENT packet that
+ * changes the buttons; read() returns as many whole events as fit in its
+ * buffer, blocking until one arrives unless the port is non-blocking, and
+ * poll()/select()/epoll report the port readable while any are queued.
+ * If the queue is full, changes are dropped; TUX_LOST_EVENTS counts them.
+ * Buttons use the TUX_BUTTONS layout (bits 7:0 are right, down, left, up,
+ * C, B, A, START), with a bit clear while its button is held down.
+ */
+struct tux_event {
+	unsigned long long time_ns;	/* arrival time (CLOCK_MONOTONIC) */
+	unsigned char buttons;		/* buttons after the change */
+	unsigned char changed;		/* buttons changed (1 bits) */
+	unsigned char unused[6];	/* zero */
+};
 
 void process_rcvd_pckt0(unsigned a, unsigned b, unsigned c);	//will check 1st packet received from TUX, parse it, and store in a temp buffer which we can read
 void process_rcvd_pckt1(unsigned a, unsigned b, unsigned c);	//will check 2nd packet received from TUX, parse it, and store in a temp buffer which we can read
@@ -71,6 +71,8 @@ static struct tty_ldisc tuxctl_ldisc  = {
 	.open = tuxctl_ldisc_open,
 	.close = tuxctl_ldisc_close,
         .ioctl = tuxctl_ioctl,
+	.read = tuxctl_read,
+	.poll = tuxctl_poll,
 	.receive_buf = tuxctl_ldisc_rcv_buf,
 	.write_wakeup = tuxctl_ldisc_write_wakeup,
 };
@@ -36,4 +36,12 @@ void tuxctl_handle_packet(struct tty_struct *tty, unsigned char *packet);
  * Located in tuxctl.c
  */
 extern int tuxctl_ioctl(struct tty_struct * tty, struct file *, unsigned int cmd, unsigned long arg);
+
+/* read and poll for the line discipline: deliver queued button events.
+ * Located in tuxctl.c
+ */
+extern ssize_t tuxctl_read(struct tty_struct *tty, struct file *file,
+			   unsigned char __user *buf, size_t nr);
+extern unsigned int tuxctl_poll(struct tty_struct *tty, struct file *file,
+				struct poll_table_struct *wait);
 #endif
@@ -0,0 +1,275 @@
+/*									tab:8
+ *
+ * mp2world.c - utility program for compiling the adventure game world
+ *
+ * Filename:	    mp2world.c
+ */
+
+
+/* 
+ * This file is a standalone utility program that compiles the text world
+ * description (world.def) into the binary world file mapped by the game
+ * (see world_headers.h for both formats).  All checks that need only be 
+ * made once--that every room, object, and swap photo is described exactly
+ * once, that swap identifiers are known, and that every image file can
+ * be read--are made here, so that the game need only check the binary file's
+ * structure.
+ */
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "photo_headers.h"
+#include "world_headers.h"
+
+
+#define MAX_LINE    256	   /* longest line in the world description */
+#define MAX_TOKENS  8	   /* most words on a line                  */
+#define MAX_STRINGS 8192   /* bytes available for the string table  */
+#define MAX_IDS     1024   /* most rooms or objects in a world      */
+
+/* 
+ * Identifiers of one kind, numbered by their index in name.  Those in
+ * world_headers.h come first, in order, since the game refers to them by
+ * name.  Room and object identifiers not listed there are new, data-only
+ * rooms and objects, numbered after them in order of first appearance.
+ */
+typedef struct id_table_t id_table_t;
+struct id_table_t {
+    const char* name[MAX_IDS]; /* identifier names                   */
+    uint8_t     seen[MAX_IDS]; /* whether each has been described    */
+    int32_t     n;             /* number of identifiers              */
+    int32_t     new_ok;        /* 1 if new identifiers may be added  */
+};
+
+#define ID_NAME(id) #id,
+static id_table_t room_id = {{ROOM_IDS (ID_NAME)}, {0}, N_ROOMS, 1};
+static id_table_t obj_id = {{OBJECT_IDS (ID_NAME)}, {0}, N_OBJECTS, 1};
+static id_table_t swap_id = {{SWAP_IDS (ID_NAME)}, {0}, N_SWAPS, 0};
+
+/* the world file under construction */
+static world_room_t room[MAX_IDS];
+static world_obj_t  obj[MAX_IDS];
+static world_photo_t swap[N_SWAPS];
+static char         strings[MAX_STRINGS];
+static uint32_t     str_size = 0;
+
+/* position in the world description, for error messages */
+static const char* src_name;
+static int32_t     src_line;
+
+
+/* 
+ * Print an error message with the current file name and line number,
+ * then exit.
+ */
+static void
+fail (const char* what, const char* arg)
+{
+    fprintf (stderr, "%s:%d: %s %s\n", src_name, src_line, what, arg);
+    exit (3);
+}
+
+/* 
+ * Split a line into words, which are separated by white space.  A word
+ * may also be a quoted string (without the quotes).  Returns the number
+ * of words found.
+ */
+static int32_t
+split_line (char* line, char* word[MAX_TOKENS])
+{
+    int32_t n = 0;
+    char*   end;
+
+    while (1) {
+	line += strspn (line, " \t\r\n");
+	if ('\0' == *line || '#' == *line) {
+	    return n;
+	}
+	if (MAX_TOKENS == n) {
+	    fail ("too many words on line", "");
+	}
+	if ('"' == *line) {
+	    word[n++] = ++line;
+	    if (NULL == (end = strchr (line, '"'))) {
+		fail ("unterminated name", word[n - 1]);
+	    }
+	} else {
+	    word[n++] = line;
+	    end = line + strcspn (line, " \t\r\n");
+	}
+	if ('\0' == *end) {
+	    return n;
+	}
+	*end = '\0';
+	line = end + 1;
+    }
+}
+
+/* 
+ * Find an identifier's number in a table, adding it if it is new and the
+ * table allows new identifiers.  R_NONE is accepted (as -1) if none_ok is
+ * set.
+ */
+static int32_t
+find_id (id_table_t* t, const char* id, int32_t none_ok)
+{
+    int32_t i;
+
+    if (none_ok && 0 == strcmp (id, "R_NONE")) {
+        return R_NONE;
+    }
+    for (i = 0; t->n > i; i++) {
+	if (0 == strcmp (t->name[i], id)) {
+	    return i;
+	}
+    }
+    if (!t->new_ok) {
+	fail ("unknown identifier", id);
+    }
+    if (MAX_IDS == t->n || NULL == (t->name[t->n] = strdup (id))) {
+	fail ("too many identifiers at", id);
+    }
+    return t->n++;
+}
+
+/* Find or add a string in the string table.  Returns its offset. */
+static uint32_t
+add_string (const char* s)
+{
+    uint32_t off;
+    size_t   len = strlen (s) + 1;
+
+    for (off = 0; str_size > off; off += strlen (strings + off) + 1) {
+	if (0 == strcmp (strings + off, s)) {
+	    return off;
+	}
+    }
+    if (MAX_STRINGS - str_size < len) {
+	fail ("string table is full at", s);
+    }
+    memcpy (strings + str_size, s, len);
+    str_size += len;
+    return off;
+}
+
+/* Record an image file's name and size. */
+static void
+add_image (world_photo_t* p, const char* fname)
+{
+    FILE*          in;
+    photo_header_t hdr;
+
+    if (NULL == (in = fopen (fname, "rb")) ||
+	1 != fread (&hdr, sizeof (hdr), 1, in)) {
+	fail ("cannot read image", fname);
+    }
+    (void)fclose (in);
+    p->file = add_string (fname);
+    p->width = hdr.width;
+    p->height = hdr.height;
+}
+
+/* Mark an identifier as described, failing if it was already. */
+static void
+mark_seen (id_table_t* t, int32_t id)
+{
+    if (t->seen[id]) {
+	fail ("described twice:", t->name[id]);
+    }
+    t->seen[id] = 1;
+}
+
+/* Check that every identifier in a table has been described. */
+static void
+check_seen (const id_table_t* t)
+{
+    int32_t i;
+
+    for (i = 0; t->n > i; i++) {
+	if (!t->seen[i]) {
+	    fail ("never described:", t->name[i]);
+	}
+    }
+}
+
+int
+main (int argc, char* argv[])
+{
+    FILE*          in;
+    FILE*          out;
+    char           line[MAX_LINE];
+    char*          word[MAX_TOKENS];
+    int32_t        n;
+    int32_t        id;
+    world_header_t h = {WORLD_MAGIC, WORLD_VERSION, 0, 0, 0, 0, 0};
+
+    if (3 != argc) {
+	fprintf (stderr, "syntax: %s <world description> <world file>\n", 
+		 argv[0]);
+	return 2;
+    }
+    src_name = argv[1];
+    if (NULL == (in = fopen (argv[1], "r"))) {
+	perror (argv[1]);
+	return 2;
+    }
+
+    for (src_line = 1; NULL != fgets (line, MAX_LINE, in); src_line++) {
+	if (NULL == strchr (line, '\n') && !feof (in)) {
+	    fail ("line too long", "");
+	}
+	if (0 == (n = split_line (line, word))) {
+	    continue;
+	}
+	if (0 == strcmp (word[0], "room") && 7 == n) {
+	    id = find_id (&room_id, word[1], 0);
+	    mark_seen (&room_id, id);
+	    room[id].name = add_string (word[2]);
+	    add_image (&room[id].photo, word[3]);
+	    room[id].left = find_id (&room_id, word[4], 1);
+	    room[id].enter = find_id (&room_id, word[5], 1);
+	    room[id].right = find_id (&room_id, word[6], 1);
+	} else if (0 == strcmp (word[0], "object") && (5 == n || 7 == n)) {
+	    id = find_id (&obj_id, word[1], 0);
+	    mark_seen (&obj_id, id);
+	    obj[id].name = add_string (word[2]);
+	    add_image (&obj[id].image, word[3]);
+	    obj[id].room = find_id (&room_id, word[4], 1);
+	    obj[id].x = (7 == n ? atoi (word[5]) : -1);
+	    obj[id].y = (7 == n ? atoi (word[6]) : -1);
+	    if (7 == n && (0 > obj[id].x || 0 > obj[id].y)) {
+		fail ("bad position for", word[1]);
+	    }
+	} else if (0 == strcmp (word[0], "swap") && 3 == n) {
+	    id = find_id (&swap_id, word[1], 0);
+	    mark_seen (&swap_id, id);
+	    add_image (&swap[id], word[2]);
+	} else {
+	    fail ("cannot parse line starting with", word[0]);
+	}
+    }
+    (void)fclose (in);
+    check_seen (&room_id);
+    check_seen (&obj_id);
+    check_seen (&swap_id);
+
+    h.n_rooms = room_id.n;
+    h.n_objects = obj_id.n;
+    h.n_swaps = swap_id.n;
+    h.str_size = str_size;
+    if (NULL == (out = fopen (argv[2], "wb")) ||
+	1 != fwrite (&h, sizeof (h), 1, out) ||
+	h.n_rooms != fwrite (room, sizeof (room[0]), h.n_rooms, out) ||
+	h.n_objects != fwrite (obj, sizeof (obj[0]), h.n_objects, out) ||
+	h.n_swaps != fwrite (swap, sizeof (swap[0]), h.n_swaps, out) ||
+	str_size != fwrite (strings, 1, str_size, out) ||
+	0 != fclose (out)) {
+	perror (argv[2]);
+	return 3;
+    }
+    return 0;
+}
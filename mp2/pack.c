@@ -0,0 +1,317 @@
+/*									tab:8
+ *
+ * pack.c - image pack loader (and, with PACK_WRITE_PROGRAM, the packer)
+ *
+ * Filename:	    pack.c
+ *
+ * The game maps the whole pack read-only with a single mmap and never
+ * unmaps it: object images point straight into the mapping, and room
+ * photos are quantized from it without reading the file again.  The
+ * index is checked once when the pack is opened, so lookups can trust
+ * every entry.  If the pack is missing or bad, pack_find finds nothing
+ * and photo.c falls back to reading the individual image files.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pack.h"
+
+
+/* local functions--see function headers for details */
+static int32_t check_pack (const uint8_t* base, size_t len);
+static int compare_entry (const void* key, const void* elt);
+
+
+/* file-scope variables */
+static const uint8_t*      pack_base = NULL;  /* mapping, or NULL if none */
+static const pack_entry_t* pack_index = NULL; /* sorted entries in pack   */
+static uint32_t            pack_count = 0;    /* number of entries        */
+
+
+/*
+ * pack_open
+ *   DESCRIPTION: Map an image pack into memory and check its index.
+ *                Does nothing if a pack is already open.
+ *   INPUTS: fname -- file name of the pack
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, or -1 if the pack cannot be opened or
+ *                 is not a valid pack
+ *   SIDE EFFECTS: maps the pack for the rest of the program
+ */
+int32_t
+pack_open (const char* fname)
+{
+    int         fd;   /* pack file descriptor */
+    struct stat st;   /* pack file status     */
+    void*       base; /* mapping of the pack  */
+
+    if (NULL != pack_base) {
+        return 0;
+    }
+    if (0 > (fd = open (fname, O_RDONLY))) {
+        return -1;
+    }
+    if (0 != fstat (fd, &st) || sizeof (pack_header_t) > (size_t)st.st_size ||
+	MAP_FAILED == (base = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+				    fd, 0))) {
+	(void)close (fd);
+	return -1;
+    }
+    (void)close (fd); /* the mapping holds its own reference */
+
+    if (0 != check_pack (base, st.st_size)) {
+	(void)munmap (base, st.st_size);
+        return -1;
+    }
+    pack_base = base;
+    pack_index = (const pack_entry_t*)(pack_base + sizeof (pack_header_t));
+    pack_count = ((const pack_header_t*)pack_base)->count;
+    return 0;
+}
+
+
+/*
+ * pack_find
+ *   DESCRIPTION: Find an image in the pack by file name (binary search
+ *                of the sorted index).
+ *   INPUTS: name -- image file name
+ *           kind -- PACK_PHOTO or PACK_OBJECT
+ *   OUTPUTS: hdr -- width and height of the image
+ *   RETURN VALUE: pointer to the image's pixels in the mapping, or NULL
+ *                 if no pack is open or it holds no such image
+ *   SIDE EFFECTS: none
+ */
+const void*
+pack_find (const char* name, int32_t kind, photo_header_t* hdr)
+{
+    const pack_entry_t* e; /* entry found */
+
+    if (NULL == pack_base ||
+	NULL == (e = bsearch (name, pack_index, pack_count, sizeof (*e),
+			      compare_entry)) ||
+	kind != e->kind) {
+        return NULL;
+    }
+    *hdr = e->hdr;
+    return pack_base + e->offset;
+}
+
+
+/*
+ * check_pack
+ *   DESCRIPTION: Check a mapped pack's header and index: entry names must
+ *                be terminated and sorted, and each entry's pixels must
+ *                be aligned, lie within the pack, and match its kind and
+ *                dimensions.
+ *   INPUTS: base -- start of the mapping
+ *           len -- length of the mapping in bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the pack is valid, or -1 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t
+check_pack (const uint8_t* base, size_t len)
+{
+    const pack_header_t* h = (const pack_header_t*)base; /* pack header */
+    const pack_entry_t*  e;      /* entries in index        */
+    uint32_t             i;      /* index over entries      */
+    uint32_t             bpp;    /* bytes per pixel         */
+
+    if (PACK_MAGIC != h->magic || PACK_VERSION != h->version ||
+	(len - sizeof (*h)) / sizeof (*e) < h->count) {
+        return -1;
+    }
+    e = (const pack_entry_t*)(base + sizeof (*h));
+    for (i = 0; h->count > i; i++) {
+	bpp = (PACK_PHOTO == e[i].kind ? 2 : 1);
+	if (NULL == memchr (e[i].name, '\0', PACK_NAME_LEN) ||
+	    (0 < i && 0 <= strcmp (e[i - 1].name, e[i].name)) ||
+	    (PACK_PHOTO != e[i].kind && PACK_OBJECT != e[i].kind) ||
+	    0 != e[i].offset % PACK_ALIGN ||
+	    e[i].offset > len || e[i].size > len - e[i].offset ||
+	    (uint32_t)e[i].hdr.width * e[i].hdr.height * bpp != e[i].size) {
+	    return -1;
+	}
+    }
+    return 0;
+}
+
+
+/*
+ * compare_entry
+ *   DESCRIPTION: Compare a name with a pack entry's name (for bsearch).
+ *   INPUTS: key -- the name
+ *           elt -- the pack entry
+ *   OUTPUTS: none
+ *   RETURN VALUE: negative, zero, or positive as the name sorts before,
+ *                 equal to, or after the entry's name
+ *   SIDE EFFECTS: none
+ */
+static int
+compare_entry (const void* key, const void* elt)
+{
+    return strcmp ((const char*)key, ((const pack_entry_t*)elt)->name);
+}
+
+
+#if defined(PACK_WRITE_PROGRAM) /* mp2pack: build a pack from image files */
+
+#include <stdio.h>
+
+/*
+ * compare_names
+ *   DESCRIPTION: Compare two pack entries by name (for qsort).
+ *   INPUTS: a, b -- the pack entries
+ *   OUTPUTS: none
+ *   RETURN VALUE: negative, zero, or positive as a sorts before, equal
+ *                 to, or after b
+ *   SIDE EFFECTS: none
+ */
+static int
+compare_names (const void* a, const void* b)
+{
+    return strcmp (((const pack_entry_t*)a)->name,
+		   ((const pack_entry_t*)b)->name);
+}
+
+/*
+ * read_entry
+ *   DESCRIPTION: Read one image file into memory for the pack, with its
+ *                rows reordered from bottom-up to top-down.  The kind
+ *                of image is given by the file name's suffix (.photo or
+ *                .obj).
+ *   INPUTS: fname -- image file name
+ *   OUTPUTS: e -- index entry for the image (all but offset)
+ *   RETURN VALUE: pointer to newly allocated pixel data, or NULL on
+ *                 failure
+ *   SIDE EFFECTS: prints an error message to stderr on failure
+ */
+static uint8_t*
+read_entry (const char* fname, pack_entry_t* e)
+{
+    const char* dot = strrchr (fname, '.'); /* start of suffix       */
+    FILE*       in;                         /* image file            */
+    uint8_t*    pix = NULL;                 /* pixels, top row first */
+    uint32_t    row;                        /* bytes per row         */
+    uint32_t    y;                          /* index over rows       */
+
+    (void)memset (e, 0, sizeof (*e));
+    if (PACK_NAME_LEN <= strlen (fname) || NULL == dot ||
+	(0 != strcmp (dot, ".photo") && 0 != strcmp (dot, ".obj"))) {
+	fprintf (stderr, "%s: not a .photo or .obj file name under %d "
+		 "characters\n", fname, PACK_NAME_LEN);
+	return NULL;
+    }
+    strcpy (e->name, fname);
+    e->kind = (0 == strcmp (dot, ".photo") ? PACK_PHOTO : PACK_OBJECT);
+    if (NULL == (in = fopen (fname, "rb")) ||
+	1 != fread (&e->hdr, sizeof (e->hdr), 1, in)) {
+	perror (fname);
+	if (NULL != in) {
+	    (void)fclose (in);
+	}
+	return NULL;
+    }
+    row = e->hdr.width * (PACK_PHOTO == e->kind ? 2 : 1);
+    e->size = row * e->hdr.height;
+    if (NULL == (pix = malloc (e->size + 1))) {
+	perror ("malloc");
+	(void)fclose (in);
+        return NULL;
+    }
+    for (y = e->hdr.height; y-- > 0; ) {
+	if (row != fread (pix + row * y, 1, row, in)) {
+	    fprintf (stderr, "%s: file is too short\n", fname);
+	    free (pix);
+	    (void)fclose (in);
+	    return NULL;
+	}
+    }
+    (void)fclose (in);
+    return pix;
+}
+
+/*
+ * main -- image packer
+ *   DESCRIPTION: Write a pack holding the images in the files named on
+ *                the command line.  Names are stored as given, so they
+ *                must match those used by the game (e.g., images/x.obj).
+ *   INPUTS: argv[1] -- pack file name
+ *           argv[2..] -- image file names
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, or 3 on failure
+ *   SIDE EFFECTS: writes the pack file
+ */
+int
+main (int argc, const char* argv[])
+{
+    static const uint8_t zeros[PACK_ALIGN]; /* padding           */
+    pack_header_t h = {PACK_MAGIC, PACK_VERSION, 0, 0}; /* header */
+    pack_entry_t* e;     /* index entries, in argument order  */
+    uint8_t**     pix;   /* pixel data, in argument order     */
+    pack_entry_t* out;   /* index entries, sorted by name     */
+    uint32_t      i;     /* index over images                 */
+    uint32_t      off;   /* offset of next data in pack       */
+    FILE*         f;     /* pack file                         */
+
+    if (3 > argc) {
+	fprintf (stderr, "syntax: %s <pack> <image file> ...\n", argv[0]);
+	return 3;
+    }
+    h.count = argc - 2;
+    if (NULL == (e = calloc (h.count, sizeof (*e))) ||
+	NULL == (out = calloc (h.count, sizeof (*out))) ||
+	NULL == (pix = calloc (h.count, sizeof (*pix)))) {
+	perror ("calloc");
+	return 3;
+    }
+
+    /* Read the images and lay out their data after the index. */
+    off = sizeof (h) + h.count * sizeof (*e);
+    for (i = 0; h.count > i; i++) {
+	if (NULL == (pix[i] = read_entry (argv[i + 2], &e[i]))) {
+	    return 3;
+	}
+	off = (off + PACK_ALIGN - 1) & ~(PACK_ALIGN - 1);
+	e[i].offset = off;
+	off += e[i].size;
+    }
+    (void)memcpy (out, e, h.count * sizeof (*e));
+    qsort (out, h.count, sizeof (*out), compare_names);
+    for (i = 1; h.count > i; i++) {
+	if (0 == strcmp (out[i - 1].name, out[i].name)) {
+	    fprintf (stderr, "%s: named twice\n", out[i].name);
+	    return 3;
+	}
+    }
+
+    /* Write the header, the sorted index, and the data in file order. */
+    if (NULL == (f = fopen (argv[1], "wb")) ||
+	1 != fwrite (&h, sizeof (h), 1, f) ||
+	h.count != fwrite (out, sizeof (*out), h.count, f)) {
+	perror (argv[1]);
+	return 3;
+    }
+    off = sizeof (h) + h.count * sizeof (*e);
+    for (i = 0; h.count > i; i++) {
+	if (e[i].offset - off != fwrite (zeros, 1, e[i].offset - off, f) ||
+	    e[i].size != fwrite (pix[i], 1, e[i].size, f)) {
+	    perror (argv[1]);
+	    return 3;
+	}
+	off = e[i].offset + e[i].size;
+    }
+    if (0 != fclose (f)) {
+	perror (argv[1]);
+	return 3;
+    }
+    printf ("%s: %u images, %u bytes\n", argv[1], h.count, off);
+    return 0;
+}
+
+#endif /* PACK_WRITE_PROGRAM */
@@ -0,0 +1,69 @@
+/*									tab:8
+ *
+ * pack.h - header file for the adventure game's image pack
+ *
+ * Filename:	    pack.h
+ */
+
+#ifndef PACK_H
+#define PACK_H
+
+
+#include <stdint.h>
+
+#include "photo_headers.h"
+
+
+/*
+ * An image pack holds every room photo and object image in one file,
+ * which the game maps into memory once instead of opening each image
+ * file.  The file starts with a pack_header_t, followed by count
+ * pack_entry_t's sorted by name, followed by the pixel data.  Each
+ * entry's pixels start at a multiple of PACK_ALIGN bytes from the start
+ * of the file and are stored in the order used in memory by photo.c:
+ * from the upper left, top row first (image files store the bottom row
+ * first).  Photo pixels are 16-bit 5:6:5 RGB; object image pixels are
+ * 8-bit 2:2:2 RGB.  All values are little-endian, as in the image files.
+ * Packs are written by mp2pack (pack.c compiled with PACK_WRITE_PROGRAM).
+ */
+
+#define PACK_FILE     "images.pack" /* pack read by the game            */
+#define PACK_MAGIC    0x4B503250    /* "P2PK" in a little-endian file    */
+#define PACK_VERSION  1
+#define PACK_NAME_LEN 48            /* name space, including the NUL     */
+#define PACK_ALIGN    8             /* alignment of pixel data in file   */
+
+/* kinds of pack entries */
+enum {PACK_PHOTO, PACK_OBJECT};
+
+typedef struct pack_header_t pack_header_t;
+struct pack_header_t {
+    uint32_t magic;   /* PACK_MAGIC          */
+    uint32_t version; /* PACK_VERSION        */
+    uint32_t count;   /* number of entries   */
+    uint32_t unused;  /* zero                */
+};
+
+typedef struct pack_entry_t pack_entry_t;
+struct pack_entry_t {
+    char     name[PACK_NAME_LEN]; /* image file name, e.g., images/x.obj */
+    uint32_t offset;              /* file offset of pixel data           */
+    uint32_t size;                /* bytes of pixel data                 */
+    uint16_t kind;                /* PACK_PHOTO or PACK_OBJECT           */
+    uint16_t unused;              /* zero                                */
+    photo_header_t hdr;           /* width and height in pixels          */
+};
+
+/* Map a pack into memory.  Returns 0, or -1 if it is missing or bad. */
+extern int32_t pack_open (const char* fname);
+
+/*
+ * Find an image of a given kind in the mapped pack.  Returns a pointer to
+ * its pixels in the mapping, which stays valid until the program exits,
+ * and fills in hdr; returns NULL if no pack is open or the image is not in
+ * it.
+ */
+extern const void* pack_find (const char* name, int32_t kind,
+			      photo_header_t* hdr);
+
+#endif /* PACK_H */
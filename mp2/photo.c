@@ -40,6 +40,7 @@
 
 #include "assert.h"
 #include "modex.h"
+#include "pack.h"
 #include "photo.h"
 #include "photo_headers.h"
 #include "world.h"
@@ -73,18 +74,48 @@ struct photo_t {
 struct image_t {
     photo_header_t hdr;			/* defines height and width */
     uint8_t*       img;                 /* pixel data               */
+    image_span_t*  span;		/* opaque span of each row  */
+};
+
+/* 
+ * The columns of an object image row from its first to its last opaque
+ * pixel (lo inclusive, hi exclusive; both 0 if the row is transparent).
+ * Drawing an object need only look at these columns.
+ */
+struct image_span_t {
+    uint8_t lo;
+    uint8_t hi;
 };
 
 
+/* local functions--see function headers for details */
+static void build_composite (const rect_t* rect);
+static photo_t* packed_photo (arena_t* a, const photo_header_t* hdr, 
+			      const uint16_t* pix);
+static int32_t find_spans (arena_t* a, image_t* img);
+
+
 /* file-scope variables */
 
 /* 
- * The room currently shown on the screen.  This value is not known to 
- * the mode X code, but is needed when filling buffers in callbacks from 
- * that code (fill_horiz_buffer/fill_vert_buffer).  The value is set 
- * by calling prep_room.
+ * A view of the room currently shown on the screen.  This value is not
+ * known to the mode X code, but is needed when filling buffers in
+ * callbacks from that code (fill_horiz_buffer/fill_vert_buffer).  The 
+ * value is set by prep_room and composite_changed, which are called by
+ * the render thread, so the game may change the room itself meanwhile.
  */
-static const room_t* cur_room = NULL; 
+static room_view_t cur_view; 
+
+/*
+ * The current room's photo with the room's objects drawn over it, so
+ * that filling a line is a plain copy no matter how many objects are in
+ * the room.  The composite is built by prep_room and patched by
+ * composite_changed when objects move.  It covers at least the scrolling
+ * region; pixels outside of the photo are 0.  Rows are comp_width pixels.
+ */
+static uint8_t composite[MAX_PHOTO_WIDTH * MAX_PHOTO_HEIGHT];
+static int32_t comp_width;   /* composite width in pixels  */
+static int32_t comp_height;  /* composite height in pixels */
 
 
 /* 
@@ -95,7 +126,7 @@ static const room_t* cur_room = NULL;
  *                is represented as a single byte in the image.
  *
  *                Note that this routine draws both the room photo and
- *                the objects in the room.
+ *                the objects in the room (copied from the composite).
  *
  *   INPUTS: (x,y) -- leftmost pixel of line to be drawn 
  *   OUTPUTS: buf -- buffer holding image data for the line
@@ -105,62 +136,20 @@ static const room_t* cur_room = NULL;
 void
 fill_horiz_buffer (int x, int y, unsigned char buf[SCROLL_X_DIM])
 {
-    int            idx;   /* loop index over pixels in the line          */ 
-    object_t*      obj;   /* loop index over objects in the current room */
-    int            imgx;  /* loop index over pixels in object image      */ 
-    int            yoff;  /* y offset into object image                  */ 
-    uint8_t        pixel; /* pixel from object image                     */
-    const photo_t* view;  /* room photo                                  */
-    int32_t        obj_x; /* object x position                           */
-    int32_t        obj_y; /* object y position                           */
-    const image_t* img;   /* object image                                */
+    int idx;   /* loop index over pixels in the line */ 
 
-    /* Get pointer to current photo of current room. */
-    view = room_photo (cur_room);
+    /* The view window normally lies within the composite. */
+    if (0 <= x && comp_width >= x + SCROLL_X_DIM && 
+        0 <= y && comp_height > y) {
+	(void)memcpy (buf, &composite[comp_width * y + x], SCROLL_X_DIM);
+	return;
+    }
 
     /* Loop over pixels in line. */
     for (idx = 0; idx < SCROLL_X_DIM; idx++) {
-        buf[idx] = (0 <= x + idx && view->hdr.width > x + idx ?
-		    view->img[view->hdr.width * y + x + idx] : 0);
-    }
-
-    /* Loop over objects in the current room. */
-    for (obj = room_contents_iterate (cur_room); NULL != obj;
-    	 obj = obj_next (obj)) {
-	obj_x = obj_get_x (obj);
-	obj_y = obj_get_y (obj);
-	img = obj_image (obj);
-
-        /* Is object outside of the line we're drawing? */
-	if (y < obj_y || y >= obj_y + img->hdr.height ||
-	    x + SCROLL_X_DIM <= obj_x || x >= obj_x + img->hdr.width) {
-	    continue;
-	}
-
-	/* The y offset of drawing is fixed. */
-	yoff = (y - obj_y) * img->hdr.width;
-
-	/* 
-	 * The x offsets depend on whether the object starts to the left
-	 * or to the right of the starting point for the line being drawn.
-	 */
-	if (x <= obj_x) {
-	    idx = obj_x - x;
-	    imgx = 0;
-	} else {
-	    idx = 0;
-	    imgx = x - obj_x;
-	}
-
-	/* Copy the object's pixel data. */
-	for (; SCROLL_X_DIM > idx && img->hdr.width > imgx; idx++, imgx++) {
-	    pixel = img->img[yoff + imgx];
-
-	    /* Don't copy transparent pixels. */
-	    if (OBJ_CLR_TRANSP != pixel) {
-		buf[idx] = pixel;
-	    }
-	}
+        buf[idx] = (0 <= x + idx && comp_width > x + idx &&
+		    0 <= y && comp_height > y ?
+		    composite[comp_width * y + x + idx] : 0);
     }
 }
 
@@ -173,7 +162,7 @@ fill_horiz_buffer (int x, int y, unsigned char buf[SCROLL_X_DIM])
  *                is represented as a single byte in the image.
  *
  *                Note that this routine draws both the room photo and
- *                the objects in the room.
+ *                the objects in the room (copied from the composite).
  *
  *   INPUTS: (x,y) -- top pixel of line to be drawn 
  *   OUTPUTS: buf -- buffer holding image data for the line
@@ -183,60 +172,136 @@ fill_horiz_buffer (int x, int y, unsigned char buf[SCROLL_X_DIM])
 void
 fill_vert_buffer (int x, int y, unsigned char buf[SCROLL_Y_DIM])
 {
-    int            idx;   /* loop index over pixels in the line          */ 
-    object_t*      obj;   /* loop index over objects in the current room */
-    int            imgy;  /* loop index over pixels in object image      */ 
-    int            xoff;  /* x offset into object image                  */ 
-    uint8_t        pixel; /* pixel from object image                     */
+    int idx;   /* loop index over pixels in the line */ 
+
+    /* Loop over pixels in line. */
+    for (idx = 0; idx < SCROLL_Y_DIM; idx++) {
+        buf[idx] = (0 <= y + idx && comp_height > y + idx &&
+		    0 <= x && comp_width > x ?
+		    composite[comp_width * (y + idx) + x] : 0);
+    }
+}
+
+
+/* 
+ * composite_changed
+ *   DESCRIPTION: Rebuild part of the current room's composite after
+ *                objects in the room have moved.
+ *   INPUTS: rv -- a new view of the current room
+ *           rect -- the changed region in photo coordinates, or NULL if
+ *                   the whole room (including its photo) has changed
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: replaces the recorded view and updates the composite
+ */
+void
+composite_changed (const room_view_t* rv, const rect_t* rect)
+{
+    cur_view = *rv;
+    build_composite (rect);
+}
+
+
+/* 
+ * build_composite
+ *   DESCRIPTION: Copy the current room's photo into a region of the 
+ *                composite, then draw the room's objects over it (in 
+ *                the same order as the room contents, so later objects
+ *                cover earlier ones).  Uses the recorded view.
+ *   INPUTS: rect -- the region to build in photo coordinates, or NULL to
+ *                   resize and build the whole composite
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the composite
+ */
+static void
+build_composite (const rect_t* rect)
+{
     const photo_t* view;  /* room photo                                  */
+    int32_t        i;     /* loop index over objects in the current room */
+    const uint8_t* pix;   /* object image pixels                         */
+    const image_span_t* span; /* opaque spans of object image rows      */
+    int32_t        x_lo;  /* region to build, clipped to the composite   */
+    int32_t        y_lo;
+    int32_t        x_hi;
+    int32_t        y_hi;
+    int32_t        ox_lo; /* region covered by object, clipped           */
+    int32_t        oy_lo;
+    int32_t        ox_hi;
+    int32_t        oy_hi;
+    int32_t        x;     /* loop index over columns                     */
+    int32_t        y;     /* loop index over rows                        */
     int32_t        obj_x; /* object x position                           */
     int32_t        obj_y; /* object y position                           */
-    const image_t* img;   /* object image                                */
+    int32_t        obj_w; /* object image width                          */
+    int32_t        sx_lo; /* columns of row to draw: clipped opaque span  */
+    int32_t        sx_hi;
+    uint8_t        pixel; /* pixel from object image                     */
+    uint8_t*       row;   /* row of the composite                        */
+    const uint8_t* src;   /* row of the object image                     */
 
     /* Get pointer to current photo of current room. */
-    view = room_photo (cur_room);
-
-    /* Loop over pixels in line. */
-    for (idx = 0; idx < SCROLL_Y_DIM; idx++) {
-        buf[idx] = (0 <= y + idx && view->hdr.height > y + idx ?
-		    view->img[view->hdr.width * (y + idx) + x] : 0);
+    view = cur_view.photo;
+
+    if (NULL == rect) {
+	comp_width = (SCROLL_X_DIM > view->hdr.width ? 
+		      SCROLL_X_DIM : view->hdr.width);
+	comp_height = (SCROLL_Y_DIM > view->hdr.height ? 
+		       SCROLL_Y_DIM : view->hdr.height);
+        x_lo = y_lo = 0;
+	x_hi = comp_width;
+	y_hi = comp_height;
+    } else {
+        x_lo = (0 > rect->x_lo ? 0 : rect->x_lo);
+        y_lo = (0 > rect->y_lo ? 0 : rect->y_lo);
+        x_hi = (comp_width < rect->x_hi ? comp_width : rect->x_hi);
+        y_hi = (comp_height < rect->y_hi ? comp_height : rect->y_hi);
+    }
+    if (x_lo >= x_hi || y_lo >= y_hi) {
+        return;
     }
 
-    /* Loop over objects in the current room. */
-    for (obj = room_contents_iterate (cur_room); NULL != obj;
-    	 obj = obj_next (obj)) {
-	obj_x = obj_get_x (obj);
-	obj_y = obj_get_y (obj);
-	img = obj_image (obj);
-
-        /* Is object outside of the line we're drawing? */
-	if (x < obj_x || x >= obj_x + img->hdr.width ||
-	    y + SCROLL_Y_DIM <= obj_y || y >= obj_y + img->hdr.height) {
-	    continue;
+    /* Copy the photo. */
+    for (y = y_lo; y_hi > y; y++) {
+	row = &composite[comp_width * y];
+	for (x = x_lo; x_hi > x; x++) {
+	    row[x] = (view->hdr.width > x && view->hdr.height > y ?
+		      view->img[view->hdr.width * y + x] : 0);
 	}
+    }
 
-	/* The x offset of drawing is fixed. */
-	xoff = x - obj_x;
+    /* Loop over objects in the current room. */
+    for (i = 0; cur_view.n_obj > i; i++) {
+	obj_x = cur_view.x[i];
+	obj_y = cur_view.y[i];
+	obj_w = cur_view.w[i];
+	pix = cur_view.pix[i];
+	span = cur_view.span[i];
+
+	/* Clip the object to the region being built. */
+	ox_lo = (x_lo > obj_x ? x_lo : obj_x);
+	oy_lo = (y_lo > obj_y ? y_lo : obj_y);
+	ox_hi = obj_x + obj_w;
+	oy_hi = obj_y + cur_view.h[i];
+	if (x_hi < ox_hi) { ox_hi = x_hi; }
+	if (y_hi < oy_hi) { oy_hi = y_hi; }
 
 	/* 
-	 * The y offsets depend on whether the object starts below or 
-	 * above the starting point for the line being drawn.
+	 * Copy the object's pixel data, skipping transparent pixels.  Only
+	 * the opaque span of each image row need be examined.
 	 */
-	if (y <= obj_y) {
-	    idx = obj_y - y;
-	    imgy = 0;
-	} else {
-	    idx = 0;
-	    imgy = y - obj_y;
-	}
-
-	/* Copy the object's pixel data. */
-	for (; SCROLL_Y_DIM > idx && img->hdr.height > imgy; idx++, imgy++) {
-	    pixel = img->img[xoff + img->hdr.width * imgy];
-
-	    /* Don't copy transparent pixels. */
-	    if (OBJ_CLR_TRANSP != pixel) {
-		buf[idx] = pixel;
+	for (y = oy_lo; oy_hi > y; y++) {
+	    row = &composite[comp_width * y];
+	    src = &pix[obj_w * (y - obj_y)];
+	    sx_lo = obj_x + span[y - obj_y].lo;
+	    sx_hi = obj_x + span[y - obj_y].hi;
+	    if (ox_lo > sx_lo) { sx_lo = ox_lo; }
+	    if (ox_hi < sx_hi) { sx_hi = ox_hi; }
+	    for (x = sx_lo; sx_hi > x; x++) {
+		pixel = src[x - obj_x];
+		if (OBJ_CLR_TRANSP != pixel) {
+		    row[x] = pixel;
+		}
 	    }
 	}
     }
@@ -272,6 +337,36 @@ image_width (const image_t* im)
     return im->hdr.width;
 }
 
+
+/* 
+ * image_pixels
+ *   DESCRIPTION: Get the pixels of an object image.
+ *   INPUTS: im -- object image pointer
+ *   OUTPUTS: none
+ *   RETURN VALUE: pixel data of object image im, top row first
+ *   SIDE EFFECTS: none
+ */
+const uint8_t*
+image_pixels (const image_t* im)
+{
+    return im->img;
+}
+
+
+/* 
+ * image_spans
+ *   DESCRIPTION: Get the opaque spans of the rows of an object image.
+ *   INPUTS: im -- object image pointer
+ *   OUTPUTS: none
+ *   RETURN VALUE: one span per row of object image im, top row first
+ *   SIDE EFFECTS: none
+ */
+const image_span_t*
+image_spans (const image_t* im)
+{
+    return im->span;
+}
+
 /* 
  * photo_height
  *   DESCRIPTION: Get height of room photo in pixels.
@@ -307,17 +402,19 @@ photo_width (const photo_t* p)
  *   DESCRIPTION: Prepare a new room for display.  You might want to set
  *                up the VGA palette registers according to the color
  *                palette that you chose for this room.
- *   INPUTS: r -- pointer to the new room
+ *   INPUTS: rv -- a view of the new room
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: changes recorded cur_room for this file
+ *   SIDE EFFECTS: changes recorded view for this file and rebuilds
+ *                 the composite
  */
 void
-prep_room (const room_t* r)
+prep_room (const room_view_t* rv)
 {
-    /* Record the current room. */
-    cur_room = r;
-    photo_t * photo = room_photo(r);
+    /* Record the current room and draw its composite. */
+    cur_view = *rv;
+    build_composite (NULL);
+    const photo_t * photo = rv->photo;
     int i;
     for (i=0; i<192; i++)
     	palette_print(64+i, (photo->palette[i][0] << 1) & 0x3F, photo->palette[i][1]& 0x3F, (photo->palette[i][2] << 1) & 0x3F);
@@ -328,40 +425,51 @@ prep_room (const room_t* r)
  * read_obj_image
  *   DESCRIPTION: Read size and pixel data in 2:2:2 RGB format from a
  *                photo file and create an image structure from it.
- *   INPUTS: fname -- file name for input
+ *   INPUTS: a -- arena from which to allocate the image
+ *           fname -- file name for input
  *   OUTPUTS: none
  *   RETURN VALUE: pointer to newly allocated photo on success, or NULL
  *                 on failure
- *   SIDE EFFECTS: dynamically allocates memory for the image
+ *   SIDE EFFECTS: allocates memory for the image from the arena
  */
 image_t*
-read_obj_image (const char* fname)
+read_obj_image (arena_t* a, const char* fname)
 {
     FILE*    in;		/* input file               */
     image_t* img = NULL;	/* image structure          */
     uint16_t x;			/* index over image columns */
     uint16_t y;			/* index over image rows    */
     uint8_t  pixel;		/* one pixel from the file  */
+    const uint8_t* packed;	/* pixels in the image pack */
+    photo_header_t hdr;		/* header in the image pack */
+
+    /* 
+     * Images in the pack are stored just as we need them, so the image
+     * can use the pack's pixels in place.  They are never written.
+     */
+    if (NULL != (packed = pack_find (fname, PACK_OBJECT, &hdr))) {
+	if (MAX_OBJECT_WIDTH < hdr.width || MAX_OBJECT_HEIGHT < hdr.height ||
+	    NULL == (img = arena_alloc (a, sizeof (*img)))) {
+	    return NULL;
+	}
+	img->hdr = hdr;
+	img->img = (uint8_t*)packed;
+	return (0 == find_spans (a, img) ? img : NULL);
+    }
 
     /* 
      * Open the file, allocate the structure, read the header, do some
      * sanity checks on it, and allocate space to hold the image pixels.
-     * If anything fails, clean up as necessary and return NULL.
+     * If anything fails, clean up as necessary and return NULL.  (Memory
+     * allocated from the arena is not freed until the arena is.)
      */
     if (NULL == (in = fopen (fname, "r+b")) ||
-	NULL == (img = malloc (sizeof (*img))) ||
-	NULL != (img->img = NULL) || /* false clause for initialization */
+	NULL == (img = arena_alloc (a, sizeof (*img))) ||
 	1 != fread (&img->hdr, sizeof (img->hdr), 1, in) ||
 	MAX_OBJECT_WIDTH < img->hdr.width ||
 	MAX_OBJECT_HEIGHT < img->hdr.height ||
-	NULL == (img->img = malloc 
-		 (img->hdr.width * img->hdr.height * sizeof (img->img[0])))) {
-	if (NULL != img) {
-	    if (NULL != img->img) {
-	        free (img->img);
-	    }
-	    free (img);
-	}
+	NULL == (img->img = arena_alloc 
+		 (a, img->hdr.width * img->hdr.height * sizeof (img->img[0])))) {
 	if (NULL != in) {
 	    (void)fclose (in);
 	}
@@ -383,8 +491,6 @@ read_obj_image (const char* fname)
 	     * return NULL.
 	     */
 	    if (1 != fread (&pixel, sizeof (pixel), 1, in)) {
-		free (img->img);
-		free (img);
 	        (void)fclose (in);
 		return NULL;
 	    }
@@ -396,7 +502,41 @@ read_obj_image (const char* fname)
 
     /* All done.  Return success. */
     (void)fclose (in);
-    return img;
+    return (0 == find_spans (a, img) ? img : NULL);
+}
+
+
+/* 
+ * find_spans
+ *   DESCRIPTION: Find the span of opaque pixels in each row of an object
+ *                image.
+ *   INPUTS: a -- arena from which to allocate the spans
+ *           img -- the image (with pixels)
+ *   OUTPUTS: img -- spans filled in
+ *   RETURN VALUE: 0 on success, or -1 on failure
+ *   SIDE EFFECTS: allocates memory for the spans from the arena
+ */
+static int32_t
+find_spans (arena_t* a, image_t* img)
+{
+    const uint8_t* row; /* row of image pixels      */
+    int32_t        lo;  /* first opaque column      */
+    int32_t        hi;  /* one past last opaque one */
+    uint16_t       y;   /* index over image rows    */
+
+    if (NULL == (img->span = arena_alloc 
+		 (a, img->hdr.height * sizeof (img->span[0])))) {
+        return -1;
+    }
+    for (y = 0; img->hdr.height > y; y++) {
+	row = &img->img[img->hdr.width * y];
+	for (hi = img->hdr.width; 0 < hi && OBJ_CLR_TRANSP == row[hi - 1]; 
+	     hi--) { }
+	for (lo = 0; hi > lo && OBJ_CLR_TRANSP == row[lo]; lo++) { }
+	img->span[y].lo = (hi > lo ? lo : 0);
+	img->span[y].hi = hi;
+    }
+    return 0;
 }
 
 
@@ -408,46 +548,49 @@ read_obj_image (const char* fname)
  *                replace this code with palette color selection, and
  *                must map the image pixels into the palette colors that
  *                you have defined.
- *   INPUTS: fname -- file name for input
+ *   INPUTS: a -- arena from which to allocate the photo
+ *           fname -- file name for input
  *   OUTPUTS: none
  *   RETURN VALUE: pointer to newly allocated photo on success, or NULL
  *                 on failure
- *   SIDE EFFECTS: dynamically allocates memory for the photo
+ *   SIDE EFFECTS: allocates memory for the photo from the arena
  */
 photo_t*
-read_photo (const char* fname)
+read_photo (arena_t* a, const char* fname)
 {
     FILE*    in;	/* input file               */
     photo_t* p = NULL;	/* photo structure          */
     uint16_t x;		/* index over image columns */
     uint16_t y;		/* index over image rows    */
     uint16_t pixel;	/* one pixel from the file  */
+    const uint16_t* packed; /* pixels in the image pack */
+    photo_header_t hdr;	/* header in the image pack */
+
+    if (NULL != (packed = pack_find (fname, PACK_PHOTO, &hdr))) {
+        return packed_photo (a, &hdr, packed);
+    }
 
     /* 
      * Open the file, allocate the structure, read the header, do some
      * sanity checks on it, and allocate space to hold the photo pixels.
-     * If anything fails, clean up as necessary and return NULL.
+     * If anything fails, clean up as necessary and return NULL.  (Memory
+     * allocated from the arena is not freed until the arena is.)
      */
     if (NULL == (in = fopen (fname, "r+b")) ||
-	NULL == (p = malloc (sizeof (*p))) ||
-	NULL != (p->img = NULL) || /* false clause for initialization */
+	NULL == (p = arena_alloc (a, sizeof (*p))) ||
 	1 != fread (&p->hdr, sizeof (p->hdr), 1, in) ||
 	MAX_PHOTO_WIDTH < p->hdr.width ||
 	MAX_PHOTO_HEIGHT < p->hdr.height ||
-	NULL == (p->img = malloc 
-		 (p->hdr.width * p->hdr.height * sizeof (p->img[0])))) {
-	if (NULL != p) {
-	    if (NULL != p->img) {
-	        free (p->img);
-	    }
-	    free (p);
-	}
+	NULL == (p->img = arena_alloc 
+		 (a, p->hdr.width * p->hdr.height * sizeof (p->img[0])))) {
 	if (NULL != in) {
 	    (void)fclose (in);
 	}
 	return NULL;
     }
 
+    /* Colors not chosen for the palette (no pixels use them) are black. */
+    (void)memset (p->palette, 0, sizeof (p->palette));
     arr_initialize();
 
      /* 
@@ -468,8 +611,6 @@ read_photo (const char* fname)
 		     */
 		    if (1 != fread (&pixel, sizeof (pixel), 1, in))
 		    {
-				free (p->img);
-				free (p);
 			    (void)fclose (in);
 				return NULL;
 		    }
@@ -494,7 +635,12 @@ read_photo (const char* fname)
     }
 
     set_plt_values(p->palette);
-    fseek(in, 0, SEEK_SET);
+
+    /* Go back to the first pixel (just past the header) for the second pass. */
+    if (0 != fseek (in, sizeof (p->hdr), SEEK_SET)) {
+	(void)fclose (in);
+	return NULL;
+    }
    
 
     /* 
@@ -512,8 +658,6 @@ read_photo (const char* fname)
 	     * return NULL.
 	     */
 	    if (1 != fread (&pixel, sizeof (pixel), 1, in)) {
-		free (p->img);
-		free (p);
 	        (void)fclose (in);
 		return NULL;
 
@@ -541,6 +685,49 @@ read_photo (const char* fname)
     return p;
 }
 
+
+/* 
+ * packed_photo
+ *   DESCRIPTION: Create a photo structure from 5:6:5 RGB pixels in the
+ *                image pack, choosing the photo's palette colors and
+ *                mapping the pixels to them as read_photo does.  The 
+ *                pixels are read from the pack's mapping in place.
+ *   INPUTS: a -- arena from which to allocate the photo
+ *           hdr -- width and height of the photo
+ *           pix -- pixels in memory order (top row first)
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to newly allocated photo on success, or NULL
+ *                 on failure
+ *   SIDE EFFECTS: allocates memory for the photo from the arena
+ */
+static photo_t*
+packed_photo (arena_t* a, const photo_header_t* hdr, const uint16_t* pix)
+{
+    photo_t* p;		/* photo structure         */
+    uint32_t n;		/* number of pixels        */
+    uint32_t i;		/* index over pixels       */
+
+    n = hdr->width * hdr->height;
+    if (MAX_PHOTO_WIDTH < hdr->width || MAX_PHOTO_HEIGHT < hdr->height ||
+	NULL == (p = arena_alloc (a, sizeof (*p))) ||
+	NULL == (p->img = arena_alloc (a, n * sizeof (p->img[0])))) {
+        return NULL;
+    }
+    p->hdr = *hdr;
+
+    /* Colors not chosen for the palette (no pixels use them) are black. */
+    (void)memset (p->palette, 0, sizeof (p->palette));
+    arr_initialize ();
+    for (i = 0; n > i; i++) {
+	insert_values (pix[i]);
+    }
+    set_plt_values (p->palette);
+    for (i = 0; n > i; i++) {
+	p->img[i] = calculate_vga (pix[i]);
+    }
+    return p;
+}
+
 //______________________________________________________________________
 
 /********************************************************************
@@ -40,6 +40,7 @@
 
 #include <stdint.h>
 
+#include "arena.h"
 #include "types.h"
 #include "modex.h"
 #include "photo_headers.h"
@@ -59,12 +60,24 @@ extern void fill_horiz_buffer (int x, int y, unsigned char buf[SCROLL_X_DIM]);
 /* Fill a buffer with the pixels for a vertical line of current room. */
 extern void fill_vert_buffer (int x, int y, unsigned char buf[SCROLL_Y_DIM]);
 
+/* 
+ * Rebuild part (rect) or all (NULL) of the current room's composite image
+ * of photo and objects from a new view of the room.
+ */
+extern void composite_changed (const room_view_t* rv, const rect_t* rect);
+
 /* Get height of object image in pixels. */
 extern uint32_t image_height (const image_t* im);
 
 /* Get width of object image in pixels. */
 extern uint32_t image_width (const image_t* im);
 
+/* Get pixel data of object image, top row first. */
+extern const uint8_t* image_pixels (const image_t* im);
+
+/* Get opaque span of each row of object image, top row first. */
+extern const image_span_t* image_spans (const image_t* im);
+
 /* Get height of room photo in pixels. */
 extern uint32_t photo_height (const photo_t* p);
 
@@ -75,13 +88,13 @@ extern uint32_t photo_width (const photo_t* p);
  * Prepare room for display (record pointer for use by callbacks, set up
  * VGA palette, etc.). 
  */
-extern void prep_room (const room_t* r);
+extern void prep_room (const room_view_t* rv);
 
-/* Read object image from a file into a dynamically allocated structure. */
-extern image_t* read_obj_image (const char* fname);
+/* Read object image from a file into a structure allocated from arena a. */
+extern image_t* read_obj_image (arena_t* a, const char* fname);
 
-/* Read room photo from a file into a dynamically allocated structure. */
-extern photo_t* read_photo (const char* fname);
+/* Read room photo from a file into a structure allocated from arena a. */
+extern photo_t* read_photo (arena_t* a, const char* fname);
 
 /* 
  * N.B.  I'm aware that Valgrind and similar tools will report the fact that
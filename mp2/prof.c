@@ -0,0 +1,351 @@
+/*									tab:8
+ *
+ * prof.c - per-phase frame timing for the adventure game
+ *
+ * Filename:	    prof.c
+ *
+ * Each tick of the event loop charges time to phases with prof_add.  At
+ * the end of the tick, the total for every phase that ran is recorded in
+ * that phase's histogram.  The render thread closes its own ticks (one
+ * per frame shown), so running totals are kept per thread; the shared
+ * histograms are protected by hist_lock.  Latencies of single events are
+ * recorded directly with prof_record.  Histograms use microsecond
+ * values bucketed log-linearly: exact below 16 us, then eight buckets per
+ * power of two, so reported percentiles are within about 6% of the true
+ * values.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+#include "prof.h"
+
+
+/* histogram parameters */
+#define LINEAR_BUCKETS 16   /* values below this are bucketed exactly   */
+#define SUB_BUCKETS     8   /* buckets per power of two above that      */
+#define NUM_BUCKETS    (LINEAR_BUCKETS + (32 - 4) * SUB_BUCKETS)
+
+/* a histogram of per-tick phase times */
+typedef struct hist_t hist_t;
+struct hist_t {
+    uint32_t count;                /* number of ticks recorded */
+    uint64_t max_ns;               /* largest value recorded   */
+    uint32_t bucket[NUM_BUCKETS];  /* counts by time bucket    */
+};
+
+
+/* local functions--see function headers for details */
+static void add_value (hist_t* h, uint64_t ns);
+static uint32_t bucket_of (uint64_t us);
+static uint64_t bucket_value (uint32_t b);
+static uint64_t percentile (const hist_t* h, uint32_t pct);
+static void request_dump (int sig);
+
+
+/* file-scope variables */
+static const char* const phase_name[NUM_PHASES] = {
+    "line fill", "plane split", "full redraw", "show screen", "text",
+    "status bar", "command", "wait", "wake late", "busy", "render",
+    "prerender", "input lat"
+};
+static __thread uint64_t tick_ns[NUM_PHASES];    /* time in this tick    */
+static __thread uint32_t tick_calls[NUM_PHASES]; /* prof_add calls       */
+static pthread_mutex_t hist_lock = PTHREAD_MUTEX_INITIALIZER;
+static hist_t   hist[NUM_PHASES];       /* per-phase histograms        */
+static uint64_t budget_ns = 50000000;   /* frame budget                */
+static uint32_t overruns;               /* ticks with busy > budget    */
+static volatile sig_atomic_t dump_requested = 0;
+
+
+/*
+ * prof_now
+ *   DESCRIPTION: Read the monotonic clock.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: current time in nanoseconds
+ *   SIDE EFFECTS: none
+ */
+uint64_t
+prof_now ()
+{
+    struct timespec ts; /* current time */
+
+    (void)clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/*
+ * prof_add
+ *   DESCRIPTION: Charge time to a phase within the calling thread's 
+ *                current tick.
+ *   INPUTS: phase -- the phase
+ *           ns -- time in nanoseconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+prof_add (phase_t phase, uint64_t ns)
+{
+    tick_ns[phase] += ns;
+    tick_calls[phase]++;
+}
+
+
+/*
+ * prof_record
+ *   DESCRIPTION: Record the time of a single event, such as a latency,
+ *                in a phase's histogram right away, apart from the
+ *                calling thread's tick.
+ *   INPUTS: phase -- the phase
+ *           ns -- time in nanoseconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+prof_record (phase_t phase, uint64_t ns)
+{
+    (void)pthread_mutex_lock (&hist_lock);
+    add_value (&hist[phase], ns);
+    (void)pthread_mutex_unlock (&hist_lock);
+}
+
+
+/*
+ * prof_end_frame
+ *   DESCRIPTION: Record the calling thread's current tick's phase totals
+ *                in the histograms, count a budget overrun if needed, and
+ *                start a new tick.
+ *                Phases that did not run during the tick are not recorded.
+ *                Also performs any dump requested by a signal.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may print to stderr
+ */
+void
+prof_end_frame ()
+{
+    int32_t p;  /* loop index over phases */
+
+    (void)pthread_mutex_lock (&hist_lock);
+    for (p = 0; NUM_PHASES > p; p++) {
+        if (0 == tick_calls[p]) {
+	    continue;
+	}
+	add_value (&hist[p], tick_ns[p]);
+    }
+    if (0 != tick_calls[PHASE_BUSY] && budget_ns < tick_ns[PHASE_BUSY]) {
+        overruns++;
+    }
+    (void)pthread_mutex_unlock (&hist_lock);
+    (void)memset (tick_ns, 0, sizeof (tick_ns));
+    (void)memset (tick_calls, 0, sizeof (tick_calls));
+
+    if (dump_requested) {
+        dump_requested = 0;
+	prof_dump (stderr);
+    }
+}
+
+
+/*
+ * prof_set_budget
+ *   DESCRIPTION: Set the frame budget used to count overruns.
+ *   INPUTS: ns -- budget in nanoseconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+prof_set_budget (uint64_t ns)
+{
+    budget_ns = ns;
+}
+
+
+/*
+ * prof_dump
+ *   DESCRIPTION: Print a table of per-phase tick counts, median, 99th
+ *                percentile, and maximum times, followed by the number
+ *                of ticks that exceeded the frame budget.
+ *   INPUTS: f -- the stream on which to print
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints to f
+ */
+void
+prof_dump (FILE* f)
+{
+    int32_t p; /* loop index over phases */
+
+    (void)pthread_mutex_lock (&hist_lock);
+    fprintf (f, "%-12s %8s %10s %10s %10s\n",
+	     "phase", "ticks", "p50 (us)", "p99 (us)", "max (us)");
+    for (p = 0; NUM_PHASES > p; p++) {
+	fprintf (f, "%-12s %8u %10llu %10llu %10llu\n", phase_name[p],
+		 hist[p].count,
+		 (unsigned long long)percentile (&hist[p], 50),
+		 (unsigned long long)percentile (&hist[p], 99),
+		 (unsigned long long)(hist[p].max_ns / 1000));
+    }
+    fprintf (f, "%u of %u ticks over the %llu us budget\n", overruns,
+	     hist[PHASE_BUSY].count, (unsigned long long)(budget_ns / 1000));
+    (void)pthread_mutex_unlock (&hist_lock);
+}
+
+
+/*
+ * prof_dump_on_signal
+ *   DESCRIPTION: Arrange for a signal to request a dump, which is printed
+ *                to stderr at the end of the current tick (the handler
+ *                itself only sets a flag).
+ *   INPUTS: sig -- the signal, e.g., SIGUSR1
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: replaces the signal's behavior
+ */
+void
+prof_dump_on_signal (int sig)
+{
+    struct sigaction sa; /* signal behavior definition structure */
+
+    (void)memset (&sa, 0, sizeof (sa));
+    sa.sa_handler = request_dump;
+    sa.sa_flags = SA_RESTART;
+    (void)sigaction (sig, &sa, NULL);
+}
+
+
+/*
+ * add_value
+ *   DESCRIPTION: Record a value in a histogram.  The caller must hold
+ *                hist_lock.
+ *   INPUTS: h -- the histogram
+ *           ns -- value in nanoseconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+add_value (hist_t* h, uint64_t ns)
+{
+    h->count++;
+    h->bucket[bucket_of (ns / 1000)]++;
+    if (h->max_ns < ns) {
+        h->max_ns = ns;
+    }
+}
+
+
+/*
+ * bucket_of
+ *   DESCRIPTION: Find the histogram bucket for a time.
+ *   INPUTS: us -- time in microseconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: bucket index
+ *   SIDE EFFECTS: none
+ */
+static uint32_t
+bucket_of (uint64_t us)
+{
+    uint32_t e; /* index of most significant bit */
+
+    if (LINEAR_BUCKETS > us) {
+        return us;
+    }
+    if (0xFFFFFFFFULL < us) {
+        return NUM_BUCKETS - 1;
+    }
+    e = 31 - __builtin_clz ((uint32_t)us);
+    return LINEAR_BUCKETS + (e - 4) * SUB_BUCKETS +
+	   ((us >> (e - 3)) & (SUB_BUCKETS - 1));
+}
+
+
+/*
+ * bucket_value
+ *   DESCRIPTION: Find the time represented by a histogram bucket (the
+ *                middle of the range of times that it holds).
+ *   INPUTS: b -- bucket index
+ *   OUTPUTS: none
+ *   RETURN VALUE: time in microseconds
+ *   SIDE EFFECTS: none
+ */
+static uint64_t
+bucket_value (uint32_t b)
+{
+    uint32_t e;    /* power of two for bucket */
+    uint64_t low;  /* smallest value in bucket */
+
+    if (LINEAR_BUCKETS > b) {
+        return b;
+    }
+    e = (b - LINEAR_BUCKETS) / SUB_BUCKETS + 4;
+    low = (1ULL << e) +
+	  (uint64_t)((b - LINEAR_BUCKETS) % SUB_BUCKETS) * (1ULL << (e - 3));
+    return low + (1ULL << (e - 4));
+}
+
+
+/*
+ * percentile
+ *   DESCRIPTION: Estimate a percentile of a histogram.
+ *   INPUTS: h -- the histogram
+ *           pct -- the percentile (0 to 100)
+ *   OUTPUTS: none
+ *   RETURN VALUE: estimated time in microseconds, at most the largest
+ *                 value recorded (0 if h is empty)
+ *   SIDE EFFECTS: none
+ */
+static uint64_t
+percentile (const hist_t* h, uint32_t pct)
+{
+    uint64_t rank; /* number of values at or below the percentile */
+    uint64_t seen; /* number of values in buckets so far          */
+    uint32_t b;    /* loop index over buckets                     */
+    uint64_t us;   /* estimate for the bucket found               */
+
+    if (0 == h->count) {
+        return 0;
+    }
+    rank = ((uint64_t)h->count * pct + 99) / 100;
+    if (0 == rank) {
+        rank = 1;
+    }
+    for (b = 0, seen = 0; NUM_BUCKETS > b; b++) {
+        if (rank <= (seen += h->bucket[b])) {
+	    break;
+	}
+    }
+
+    /* 
+     * The bucket's midpoint may exceed every value in it; clamp to the
+     * largest value recorded so that the estimate never exceeds max.
+     */
+    us = bucket_value (b);
+    if (h->max_ns / 1000 < us) {
+        us = h->max_ns / 1000;
+    }
+    return us;
+}
+
+
+/*
+ * request_dump
+ *   DESCRIPTION: Signal handler that requests a dump.
+ *   INPUTS: sig -- signal number (ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: sets dump_requested
+ */
+static void
+request_dump (int sig)
+{
+    dump_requested = 1;
+}
@@ -0,0 +1,68 @@
+/*									tab:8
+ *
+ * prof.h - header file for per-phase frame timing of the adventure game
+ *
+ * Filename:	    prof.h
+ */
+
+#ifndef PROF_H
+#define PROF_H
+
+
+#include <stdint.h>
+#include <stdio.h>
+
+
+/*
+ * Phases of an event loop tick that are timed separately.  Phases may
+ * nest: room redraws triggered by typed commands count both as line
+ * fills/plane splits and as command handling.  PHASE_BUSY is the whole
+ * tick less PHASE_WAIT, and is compared with the frame budget.
+ * PHASE_WAKE_LATE is not time spent, but how late the tick wait ended.
+ * The drawing phases (line fill through status bar) run on the render
+ * thread, which closes one tick per frame shown and charges its time
+ * for the frame to PHASE_RENDER, apart from the game logic's PHASE_BUSY.
+ * Lines it prerenders while idle are charged to PHASE_PRERENDER instead.
+ * PHASE_INPUT_LATENCY is not charged per tick either: each frame that
+ * shows the effect of input records the time from the arrival of the
+ * oldest such input to the end of show_screen (see prof_record).
+ */
+typedef enum {
+    PHASE_LINE_FILL,   /* fill_horiz_buffer/fill_vert_buffer callbacks  */
+    PHASE_PLANE_SPLIT, /* copying line images into build buffer planes  */
+    PHASE_REDRAW,      /* draw_all_lines (fills and splits not counted) */
+    PHASE_SHOW_SCREEN, /* copying the build buffer to video memory      */
+    PHASE_TEXT,        /* text_to_graphics                              */
+    PHASE_STATUS_BAR,  /* print_status_bar                              */
+    PHASE_COMMAND,     /* reading and executing player commands         */
+    PHASE_WAIT,        /* waiting for the next tick                     */
+    PHASE_WAKE_LATE,   /* wake-up time past the tick deadline (jitter)  */
+    PHASE_BUSY,        /* everything but waiting                        */
+    PHASE_RENDER,      /* render thread time spent on a frame           */
+    PHASE_PRERENDER,   /* render thread time prerendering idle lines    */
+    PHASE_INPUT_LATENCY, /* input arrival to the frame showing its effect */
+    NUM_PHASES
+} phase_t;
+
+/* Read a monotonic timestamp in nanoseconds. */
+extern uint64_t prof_now ();
+
+/* Charge time to a phase within the calling thread's current tick. */
+extern void prof_add (phase_t phase, uint64_t ns);
+
+/* Record one event's time in a phase's histogram, outside of any tick. */
+extern void prof_record (phase_t phase, uint64_t ns);
+
+/* Close the calling thread's tick: record phase totals in histograms. */
+extern void prof_end_frame ();
+
+/* Set the frame budget (in nanoseconds) used to count overruns. */
+extern void prof_set_budget (uint64_t ns);
+
+/* Print p50/p99/max for each phase and the number of budget overruns. */
+extern void prof_dump (FILE* f);
+
+/* Request a dump (at the next prof_end_frame) when a signal arrives. */
+extern void prof_dump_on_signal (int sig);
+
+#endif /* PROF_H */
@@ -0,0 +1,555 @@
+/*									tab:8
+ *
+ * render.c - render thread and frame command queue for the adventure game
+ *
+ * Filename:	    render.c
+ *
+ * The game logic sends frame commands to the render thread through a
+ * single-producer, single-consumer ring.  Only the producer writes q_head
+ * and only the consumer writes q_tail; each publishes its progress with a
+ * release store, so no lock is needed to add or remove a command.  The
+ * semaphore q_items counts published commands, letting the render thread
+ * sleep while the queue is empty.  When the queue is full, the producer
+ * yields until a slot frees up, which takes a long backlog of frames.
+ *
+ * Commands carry everything needed to draw--a view of the room, copies of
+ * the status bar strings--so the render thread never reads game state,
+ * and game logic never waits on the mode X code or on the status message
+ * lock held during drawing.
+ *
+ * Between frames, the render thread is usually idle.  Rather than sleep
+ * right away, it prerenders lines around the view window a few at a time
+ * (checking for commands in between), so that scrolling can copy them.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <string.h>
+
+#include "modex.h"
+#include "photo.h"
+#include "prof.h"
+#include "render.h"
+#include "text.h"
+
+
+#define QUEUE_SIZE        64   /* commands in ring; must be a power of two */
+#define STATUS_TEXT_LEN   40   /* characters across the status bar         */
+#define STATUS_BAR_PIXELS 5760 /* 320x18 pixels in the status bar          */
+#define PRERENDER_BATCH   4    /* lines prerendered between queue checks   */
+
+/* frame commands */
+typedef enum {
+    RC_ENTER_ROOM,  /* new room: palette, composite, view, full redraw */
+    RC_OBJECTS,     /* objects moved in the current room               */
+    RC_SCROLL,      /* view window moved                               */
+    RC_STATUS,      /* status bar text changed                         */
+    RC_SHOW,        /* frame complete: show it                         */
+    RC_QUIT         /* stop the render thread                          */
+} rc_type_t;
+
+typedef struct render_cmd_t render_cmd_t;
+struct render_cmd_t {
+    rc_type_t type;
+    union {
+	struct {                           /* RC_ENTER_ROOM, RC_OBJECTS   */
+	    room_view_t view;              /* new view of current room    */
+	    int32_t     x, y;              /* view window (RC_ENTER_ROOM) */
+	    int32_t     n_rect;            /* changed regions, or -1      */
+	    rect_t      rect[MAX_DIRTY_RECTS];
+	} room;
+	struct {                           /* RC_SCROLL                   */
+	    int32_t     x, y;              /* new view window position    */
+	} scroll;
+	struct {                           /* RC_STATUS                   */
+	    char        typed[STATUS_TEXT_LEN + 1];
+	    char        room[STATUS_TEXT_LEN + 1];
+	    char        msg[STATUS_TEXT_LEN + 1];
+	} status;
+	struct {                           /* RC_SHOW                     */
+	    uint64_t    input_ns;          /* oldest input shown, or 0    */
+	} show;
+    } u;
+};
+
+
+/* local functions--see function headers for details */
+static render_cmd_t* begin_cmd (rc_type_t type);
+static void end_cmd (void);
+static void copy_text (char* dst, const char* src);
+static void draw_rects (const rect_t* rect, int32_t n);
+static void draw_scroll (int32_t x, int32_t y);
+static void wait_for_cmd (void);
+static void* render_thread (void* ignore);
+
+
+/* file-scope variables */
+static render_cmd_t queue[QUEUE_SIZE]; /* the ring of commands            */
+static uint32_t     q_head;            /* commands sent (producer writes) */
+static uint32_t     q_tail;            /* commands done (consumer writes) */
+static sem_t        q_items;           /* commands sent but not taken     */
+static pthread_t    renderer;          /* the render thread               */
+static int32_t      running = 0;       /* render thread has started       */
+
+/* 
+ * view window position as drawn, and size of the current room (0 before
+ * the first room), used only by the render thread
+ */
+static int32_t view_x, view_y;
+static int32_t room_w = 0, room_h = 0;
+
+
+/*
+ * start_renderer
+ *   DESCRIPTION: Start the render thread with an empty command queue.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: creates a thread
+ */
+int32_t
+start_renderer ()
+{
+    q_head = q_tail = 0;
+    if (0 != sem_init (&q_items, 0, 0)) {
+        return -1;
+    }
+    if (0 != pthread_create (&renderer, NULL, render_thread, NULL)) {
+	(void)sem_destroy (&q_items);
+        return -1;
+    }
+    running = 1;
+    return 0;
+}
+
+
+/*
+ * stop_renderer
+ *   DESCRIPTION: Send a command to stop the render thread, which first
+ *                carries out all commands sent before it, and wait for
+ *                the thread to end.  Does nothing if the thread is not
+ *                running.  Used as a cleanup method, so may be called
+ *                from a signal handler in any thread; the render thread
+ *                itself does not wait for itself.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: ends the render thread
+ */
+void
+stop_renderer ()
+{
+    if (!running) {
+        return;
+    }
+    running = 0;
+    if (pthread_equal (pthread_self (), renderer)) {
+        return;
+    }
+    (void)begin_cmd (RC_QUIT);
+    end_cmd ();
+    (void)pthread_join (renderer, NULL);
+    (void)sem_destroy (&q_items);
+}
+
+
+/*
+ * render_enter_room
+ *   DESCRIPTION: Send a command to show a new room: set up the palette
+ *                and composite for the room's photo, move the view
+ *                window, and draw the whole screen.
+ *   INPUTS: rv -- a view of the new room
+ *           x, y -- the view window position
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: queues a command
+ */
+void
+render_enter_room (const room_view_t* rv, int32_t x, int32_t y)
+{
+    render_cmd_t* cmd = begin_cmd (RC_ENTER_ROOM);
+
+    cmd->u.room.view = *rv;
+    cmd->u.room.x = x;
+    cmd->u.room.y = y;
+    end_cmd ();
+}
+
+
+/*
+ * render_objects
+ *   DESCRIPTION: Send a command to redraw the parts of the current room
+ *                changed by moving objects.
+ *   INPUTS: rv -- a new view of the current room
+ *           rect -- the changed regions, in room photo coordinates
+ *           n -- the number of regions, or -1 if the whole room changed
+ *                (including its photo, so the palette is reset, too)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: queues a command
+ */
+void
+render_objects (const room_view_t* rv, const rect_t* rect, int32_t n)
+{
+    render_cmd_t* cmd = begin_cmd (RC_OBJECTS);
+
+    cmd->u.room.view = *rv;
+    cmd->u.room.n_rect = n;
+    if (0 < n) {
+	(void)memcpy (cmd->u.room.rect, rect, n * sizeof (rect[0]));
+    }
+    end_cmd ();
+}
+
+
+/*
+ * render_scroll
+ *   DESCRIPTION: Send a command to move the view window, drawing the
+ *                lines exposed by the move.
+ *   INPUTS: x, y -- the new view window position
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: queues a command
+ */
+void
+render_scroll (int32_t x, int32_t y)
+{
+    render_cmd_t* cmd = begin_cmd (RC_SCROLL);
+
+    cmd->u.scroll.x = x;
+    cmd->u.scroll.y = y;
+    end_cmd ();
+}
+
+
+/*
+ * render_status
+ *   DESCRIPTION: Send a command to redraw the status bar (see
+ *                text_to_graphics for the use of the strings).
+ *   INPUTS: typed -- the command typed so far
+ *           room -- the name of the current room
+ *           msg -- the status message (empty for none)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: queues a command
+ */
+void
+render_status (const char* typed, const char* room, const char* msg)
+{
+    render_cmd_t* cmd = begin_cmd (RC_STATUS);
+
+    copy_text (cmd->u.status.typed, typed);
+    copy_text (cmd->u.status.room, room);
+    copy_text (cmd->u.status.msg, msg);
+    end_cmd ();
+}
+
+
+/*
+ * render_show
+ *   DESCRIPTION: Send a command to show the frame drawn so far.
+ *   INPUTS: input_ns -- arrival time of the oldest input whose effect
+ *                       the frame shows, or 0 if none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: queues a command
+ */
+void
+render_show (uint64_t input_ns)
+{
+    render_cmd_t* cmd = begin_cmd (RC_SHOW); /* the command */
+
+    cmd->u.show.input_ns = input_ns;
+    end_cmd ();
+}
+
+
+/*
+ * begin_cmd
+ *   DESCRIPTION: Claim the next free slot in the command queue, waiting
+ *                for the render thread to free one if the queue is full.
+ *                The command is sent by end_cmd.
+ *   INPUTS: type -- the type of command
+ *   OUTPUTS: none
+ *   RETURN VALUE: the command slot, to be filled in by the caller
+ *   SIDE EFFECTS: may yield the processor
+ */
+static render_cmd_t*
+begin_cmd (rc_type_t type)
+{
+    render_cmd_t* cmd; /* the slot */
+
+    while (QUEUE_SIZE == q_head - __atomic_load_n (&q_tail, __ATOMIC_ACQUIRE)) {
+        (void)sched_yield ();
+    }
+    cmd = &queue[q_head & (QUEUE_SIZE - 1)];
+    cmd->type = type;
+    return cmd;
+}
+
+
+/*
+ * end_cmd
+ *   DESCRIPTION: Send the command in the slot claimed by begin_cmd.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: wakes the render thread
+ */
+static void
+end_cmd ()
+{
+    __atomic_store_n (&q_head, q_head + 1, __ATOMIC_RELEASE);
+    (void)sem_post (&q_items);
+}
+
+
+/*
+ * copy_text
+ *   DESCRIPTION: Copy as much of a string as fits on the status bar.
+ *   INPUTS: src -- the string
+ *   OUTPUTS: dst -- the copy (STATUS_TEXT_LEN + 1 bytes, NUL-terminated)
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+copy_text (char* dst, const char* src)
+{
+    (void)strncpy (dst, src, STATUS_TEXT_LEN);
+    dst[STATUS_TEXT_LEN] = '\0';
+}
+
+
+/*
+ * draw_rects
+ *   DESCRIPTION: Draw the lines on the screen that cover changed regions
+ *                of the current room.  Each region is redrawn using
+ *                whichever of horizontal or vertical lines touches fewer
+ *                pixels.
+ *   INPUTS: rect -- the changed regions, in room photo coordinates
+ *           n -- the number of regions
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws part of the screen (but not the status bar)
+ */
+static void
+draw_rects (const rect_t* rect, int32_t n)
+{
+    uint8_t row[SCROLL_Y_DIM];      /* rows to redraw                    */
+    uint8_t col[SCROLL_X_DIM];      /* columns to redraw                 */
+    int32_t i;                      /* index over regions, rows, columns */
+    int32_t x_lo, y_lo, x_hi, y_hi; /* region clipped to view window     */
+
+    (void)memset (row, 0, sizeof (row));
+    (void)memset (col, 0, sizeof (col));
+    for (i = 0; n > i; i++) {
+	/* Translate to screen coordinates and clip to the view window. */
+	x_lo = rect[i].x_lo - view_x;
+	y_lo = rect[i].y_lo - view_y;
+	x_hi = rect[i].x_hi - view_x;
+	y_hi = rect[i].y_hi - view_y;
+	if (0 > x_lo) { x_lo = 0; }
+	if (0 > y_lo) { y_lo = 0; }
+	if (SCROLL_X_DIM < x_hi) { x_hi = SCROLL_X_DIM; }
+	if (SCROLL_Y_DIM < y_hi) { y_hi = SCROLL_Y_DIM; }
+	if (x_lo >= x_hi || y_lo >= y_hi) {
+	    continue;
+	}
+
+	/* Full rows cost SCROLL_X_DIM pixels each, columns SCROLL_Y_DIM. */
+	if ((y_hi - y_lo) * SCROLL_X_DIM <= (x_hi - x_lo) * SCROLL_Y_DIM) {
+	    (void)memset (&row[y_lo], 1, y_hi - y_lo);
+	} else {
+	    (void)memset (&col[x_lo], 1, x_hi - x_lo);
+	}
+    }
+
+    for (i = 0; SCROLL_Y_DIM > i; i++) {
+	if (row[i]) {
+	    (void)draw_horiz_line (i);
+	}
+    }
+    for (i = 0; SCROLL_X_DIM > i; i++) {
+	if (col[i]) {
+	    (void)draw_vert_line (i);
+	}
+    }
+}
+
+
+/*
+ * draw_scroll
+ *   DESCRIPTION: Move the view window and draw the lines that the move
+ *                exposes (all lines, if the move exceeds the window).
+ *   INPUTS: x, y -- the new view window position
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws part or all of the screen
+ */
+static void
+draw_scroll (int32_t x, int32_t y)
+{
+    int32_t dx = x - view_x; /* horizontal motion of view window */
+    int32_t dy = y - view_y; /* vertical motion of view window   */
+    int32_t idx;             /* index over lines to draw         */
+
+    view_x = x;
+    view_y = y;
+    set_view_window (x, y);
+
+    if (SCROLL_X_DIM <= dx || -SCROLL_X_DIM >= dx ||
+	SCROLL_Y_DIM <= dy || -SCROLL_Y_DIM >= dy) {
+	draw_all_lines ();
+	return;
+    }
+    for (idx = 0; dy > idx; idx++) {
+	(void)draw_horiz_line (SCROLL_Y_DIM - 1 - idx);
+    }
+    for (idx = 0; -dy > idx; idx++) {
+	(void)draw_horiz_line (idx);
+    }
+    for (idx = 0; dx > idx; idx++) {
+	(void)draw_vert_line (SCROLL_X_DIM - 1 - idx);
+    }
+    for (idx = 0; -dx > idx; idx++) {
+	(void)draw_vert_line (idx);
+    }
+}
+
+
+/*
+ * wait_for_cmd
+ *   DESCRIPTION: Wait until a command is in the queue, prerendering lines
+ *                around the view window until none are left to draw, and
+ *                then sleeping.  Prerendering time is charged to 
+ *                PHASE_PRERENDER.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: takes a count from q_items; draws prerendered lines
+ */
+static void
+wait_for_cmd ()
+{
+    uint64_t t0;         /* start of prerendering       */
+    int32_t  n = 0;      /* batches prerendered         */
+    int32_t  asleep = 0; /* nothing left to prerender   */
+
+    t0 = prof_now ();
+    while (0 != sem_trywait (&q_items)) {
+	if (0 == room_w || 0 == prerender_lines (PRERENDER_BATCH, room_w,
+						 room_h)) {
+	    asleep = 1;
+	    break;
+	}
+	n++;
+    }
+    if (0 < n) {
+	prof_add (PHASE_PRERENDER, prof_now () - t0);
+    }
+    if (asleep) {
+	while (0 != sem_wait (&q_items) && EINTR == errno) {
+	}
+    }
+}
+
+
+/*
+ * render_thread
+ *   DESCRIPTION: Carry out frame commands in the order sent until told to
+ *                quit, sleeping while the queue is empty.  Time spent on
+ *                each frame is charged to PHASE_RENDER, and the thread's
+ *                profiler tick is closed when the frame is shown.
+ *   INPUTS: none (ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: draws to the build buffer, video memory, and palette
+ */
+static void*
+render_thread (void* ignore)
+{
+    unsigned char bar[STATUS_BAR_PIXELS]; /* status bar image           */
+    render_cmd_t* cmd;                    /* command being carried out  */
+    uint64_t      t0, t1;                 /* timestamps for profiling   */
+    uint64_t      frame_ns = 0;           /* render time for this frame */
+    int32_t       i;                      /* index over changed regions */
+
+    while (1) {
+	wait_for_cmd ();
+	/* Pairs with the release in end_cmd (sem_wait alone would do). */
+	(void)__atomic_load_n (&q_head, __ATOMIC_ACQUIRE);
+	cmd = &queue[q_tail & (QUEUE_SIZE - 1)];
+
+	t0 = prof_now ();
+	switch (cmd->type) {
+	    case RC_ENTER_ROOM:
+		discard_prerendered (0, 0, INT_MAX, INT_MAX);
+		room_w = photo_width (cmd->u.room.view.photo);
+		room_h = photo_height (cmd->u.room.view.photo);
+		prep_room (&cmd->u.room.view);
+		view_x = cmd->u.room.x;
+		view_y = cmd->u.room.y;
+		set_view_window (view_x, view_y);
+		draw_all_lines ();
+		break;
+
+	    case RC_OBJECTS:
+		if (0 > cmd->u.room.n_rect) {
+		    discard_prerendered (0, 0, INT_MAX, INT_MAX);
+		    prep_room (&cmd->u.room.view);
+		    draw_all_lines ();
+		    break;
+		}
+		for (i = 0; cmd->u.room.n_rect > i; i++) {
+		    composite_changed (&cmd->u.room.view, &cmd->u.room.rect[i]);
+		    discard_prerendered (cmd->u.room.rect[i].x_lo, 
+					 cmd->u.room.rect[i].y_lo,
+					 cmd->u.room.rect[i].x_hi, 
+					 cmd->u.room.rect[i].y_hi);
+		}
+		draw_rects (cmd->u.room.rect, cmd->u.room.n_rect);
+		break;
+
+	    case RC_SCROLL:
+		draw_scroll (cmd->u.scroll.x, cmd->u.scroll.y);
+		break;
+
+	    case RC_STATUS:
+		text_to_graphics (bar, cmd->u.status.typed, cmd->u.status.room,
+				  cmd->u.status.msg);
+		t1 = prof_now ();
+		prof_add (PHASE_TEXT, t1 - t0);
+		print_status_bar (bar);
+		prof_add (PHASE_STATUS_BAR, prof_now () - t1);
+		break;
+
+	    case RC_SHOW:
+		show_screen ();
+		t1 = prof_now ();
+		prof_add (PHASE_SHOW_SCREEN, t1 - t0);
+		if (0 != cmd->u.show.input_ns) {
+		    prof_record (PHASE_INPUT_LATENCY, 
+				 t1 - cmd->u.show.input_ns);
+		}
+		break;
+
+	    case RC_QUIT:
+		__atomic_store_n (&q_tail, q_tail + 1, __ATOMIC_RELEASE);
+		return NULL;
+	}
+	frame_ns += prof_now () - t0;
+
+	/* A frame ends when it is shown. */
+	if (RC_SHOW == cmd->type) {
+	    prof_add (PHASE_RENDER, frame_ns);
+	    prof_end_frame ();
+	    frame_ns = 0;
+	}
+
+	/* Free the slot. */
+	__atomic_store_n (&q_tail, q_tail + 1, __ATOMIC_RELEASE);
+    }
+}
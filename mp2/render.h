@@ -0,0 +1,56 @@
+/*									tab:8
+ *
+ * render.h - header file for the adventure game's render thread
+ *
+ * Filename:	    render.h
+ */
+
+#ifndef RENDER_H
+#define RENDER_H
+
+
+#include <stdint.h>
+
+#include "world.h"
+
+
+/*
+ * All drawing--the build buffer, video memory, the palette, and the status
+ * bar--is done by a render thread.  The game logic (a single thread) sends
+ * it frame commands through a lock-free queue and never waits for drawing
+ * to finish, except to stop the thread or when the queue is full.
+ * Commands are carried out in the order sent.
+ */
+
+/* Start the render thread.  Call after set_mode_X.  Returns 0 or -1. */
+extern int32_t start_renderer (void);
+
+/* Carry out all commands sent, then stop the render thread. */
+extern void stop_renderer (void);
+
+/* Show a new room (set palette, draw all) with view window at (x,y). */
+extern void render_enter_room (const room_view_t* rv, int32_t x, int32_t y);
+
+/*
+ * Redraw the n changed regions of the current room given in rect (or the
+ * whole room, with its palette, if n is -1), using a new view of the room.
+ */
+extern void render_objects (const room_view_t* rv, const rect_t* rect,
+			    int32_t n);
+
+/* Move the view window to (x,y), drawing the newly exposed lines. */
+extern void render_scroll (int32_t x, int32_t y);
+
+/* Redraw the status bar (strings are copied; any may be longer than fit). */
+extern void render_status (const char* typed, const char* room,
+			   const char* msg);
+
+/*
+ * Show the frame drawn so far on the monitor.  If the frame shows the
+ * effect of input, input_ns is the time (see prof_now) at which the
+ * oldest such input arrived, and the latency is recorded once the frame
+ * is shown; otherwise, input_ns is 0.
+ */
+extern void render_show (uint64_t input_ns);
+
+#endif /* RENDER_H */
@@ -581,11 +581,47 @@ unsigned char font_data[256][16] = {
 #define total_status_addr 1440
 #define tempstring_len 40
 #define total_status_pixel 5760
+#define text_fg_color 0x3C                                          //yellow text
+#define text_bg_color 3                                             //on blue, as in the demo
+
+/*
+ * Pixels for each possible font row byte, by plane: glyph_pixels[b][p][h] 
+ * is the color of pixel 4h + p of a row whose font bits are b.  Built on
+ * first use from the colors above.
+ */
+static unsigned char glyph_pixels[256][4][2];
+static int glyph_pixels_built = 0;
+
+/*
+ * build_glyph_pixels
+ *   DESCRIPTION: Fill glyph_pixels for the given text colors.  Font bits 
+ *                are stored most significant bit first (leftmost pixel).
+ *   INPUTS: fg -- color for set font bits
+ *           bg -- color for clear font bits
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: fills glyph_pixels
+ */
+static void
+build_glyph_pixels (unsigned char fg, unsigned char bg)
+{
+    int b;  /* loop index over font row bytes   */
+    int m;  /* loop index over pixels in a row  */
+
+    for (b = 0; b < 256; b++) {
+        for (m = 0; m < 8; m++) {
+            glyph_pixels[b][m % 4][m / 4] = ((b & (0x80 >> m)) ? fg : bg);
+        }
+    }
+    glyph_pixels_built = 1;
+}
+
 void text_to_graphics(unsigned char * buffer, const char* written_on_screen, const char* present_room, const char* status_msg)
 {
-    int i,j,k,m;                                                    
-    unsigned char mask;
+    int i,k,p;                                                    
     int letter;
+    unsigned char* dst;                                             //first byte of the character cell in plane 0
+    const unsigned char (*pix)[2];                                  //pixels of one font row, by plane
     //int length = 0;
     int offset = 0;
     int set_offset;
@@ -633,10 +669,7 @@ void text_to_graphics(unsigned char * buffer, const char* written_on_screen, con
 
     if(set_offset == 0 || set_offset == 2)                              //if status message or what we write
     {
-        for (i = 0; i < total_status_pixel; i++)                                       //we give the buffer a color. Thus we traverse all the pixels of the buffer
-        {
-            buffer[i] = 3;                                              //3 is for blue color as in the demo
-        }
+        memset(buffer, text_bg_color, total_status_pixel);              //we give the buffer a color. Thus we fill all the pixels of the buffer
     }
 
     /*
@@ -646,26 +679,22 @@ void text_to_graphics(unsigned char * buffer, const char* written_on_screen, con
         buffer[i] = 3;                                                  //3 is for blue color as in the demo
     }
     */
+    if (!glyph_pixels_built)
+        build_glyph_pixels(text_fg_color, text_bg_color);           //expand the font bits into colors once
+
     for (k = 0; k < tempstring_len; k++)                                            //loop to run over all the characters
     {
         letter = tempstring[k];                                          //get the ascii of each charcater    
-        for (i = 0; i < 16; i++)                                        //loop over all the ascii in font_data
+        dst = buffer + 80 + 2*k + offset;                               //skip the first line, then 2 addresses per character
+        for (i = 0; i < 16; i++)                                        //loop over all the rows in font_data
         {
-            mask = 0x80;                                                //will use 80 as it segregates each bit using 1000 0000
-            for (m = 0; m < 8; m++)                                     //loop over the length of the charater
+            pix = glyph_pixels[font_data[letter][i]];                   //look up all 8 pixels of the row at once
+            for (p = 0; p < 4; p++)                                     //two pixels (addresses) in each of the 4 planes
             {
-                if ((mask & font_data[letter][i]) == mask)              //check for this condition to pick up ascii from font_data
-                {
-                    for (j = 0; j < 4; j++)                             //this loop over all the 4 planes  
-                    {
-                        if(m<=3)                                        //if the plane is 0,1,2,3 then this condition.
-                            buffer[80 + (80*i) + 2*k + (m%4)*total_status_addr + offset] = 0x3C;    //just the color
-                        else                                            //if the plane is 4,5,6,7 then we have to take care of offset.    
-                            buffer[80 + (80*i) + 2*k + (m%4)*total_status_addr + 1 + offset] = 0x3C;    //just the color
-                    }
-                }
-                mask = (mask >> 1);                                     //shift the mask to get the next bit
+                dst[p*total_status_addr] = pix[p][0];
+                dst[p*total_status_addr + 1] = pix[p][1];
             }
+            dst += 80;                                                  //next row
         }
     }    
 
@@ -681,3 +710,112 @@ void text_to_graphics(unsigned char * buffer, const char* written_on_screen, con
 **      m%4 GIVES US THE PLANE.               
 **      3C GIVES US THE YELLOW COLOR.
 */////////////
+
+
+#if defined(TEXT_BENCH_PROGRAM) /* microbenchmark for text_to_graphics */
+
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_FRAMES 20000
+
+/*
+ * render_bits
+ *   DESCRIPTION: Reference renderer that tests font bits one at a time, 
+ *                as text_to_graphics did before it used glyph_pixels.  
+ *                Draws the first 40 characters of msg as a status message.
+ *   INPUTS: msg -- at least 40 characters to draw
+ *           offset -- address offset of the text
+ *   OUTPUTS: buffer -- status bar image, [plane][total_status_addr]
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+render_bits (unsigned char* buffer, const char* msg, int offset)
+{
+    int i, k, m;
+    unsigned char mask;
+    int letter;
+
+    memset(buffer, text_bg_color, total_status_pixel);
+    for (k = 0; k < tempstring_len; k++) {
+        letter = (unsigned char)msg[k];
+        for (i = 0; i < 16; i++) {
+            mask = 0x80;
+            for (m = 0; m < 8; m++) {
+                if ((mask & font_data[letter][i]) == mask)
+                    buffer[80 + (80*i) + 2*k + (m%4)*total_status_addr + 
+                           m/4 + offset] = text_fg_color;
+                mask = (mask >> 1);
+            }
+        }
+    }
+}
+
+/*
+ * elapsed_usec
+ *   DESCRIPTION: Find the time between two clock readings.
+ *   INPUTS: t0 -- earlier time
+ *           t1 -- later time
+ *   OUTPUTS: none
+ *   RETURN VALUE: microseconds from t0 to t1
+ *   SIDE EFFECTS: none
+ */
+static double
+elapsed_usec (const struct timespec* t0, const struct timespec* t1)
+{
+    return (t1->tv_sec - t0->tv_sec) * 1e6 + (t1->tv_nsec - t0->tv_nsec) / 1e3;
+}
+
+/* 
+ * main -- text_to_graphics microbenchmark
+ *   DESCRIPTION: Check that text_to_graphics draws the same status bar as
+ *                the bit-testing reference renderer, then time both and
+ *                print characters drawn per microsecond.
+ *   INPUTS: none (command line arguments are ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, 3 if the images differ
+ */   
+int
+main ()
+{
+    static unsigned char table_img[total_status_pixel];
+    static unsigned char bits_img[total_status_pixel];
+    char msg[tempstring_len + 1];
+    struct timespec t0, t1;
+    double table_usec, bits_usec;
+    int i, offset;
+
+    /* A full-width status message using every printable character. */
+    for (i = 0; i < tempstring_len; i++)
+        msg[i] = '!' + (i * 7) % 94;
+    msg[tempstring_len] = '\0';
+    offset = (60 - tempstring_len) / 2;
+
+    text_to_graphics(table_img, "", "", msg);
+    render_bits(bits_img, msg, offset);
+    if (0 != memcmp(table_img, bits_img, total_status_pixel)) {
+        puts ("text_to_graphics does not match the reference renderer");
+        return 3;
+    }
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < BENCH_FRAMES; i++)
+        text_to_graphics(table_img, "", "", msg);
+    (void)clock_gettime(CLOCK_MONOTONIC, &t1);
+    table_usec = elapsed_usec(&t0, &t1);
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < BENCH_FRAMES; i++)
+        render_bits(bits_img, msg, offset);
+    (void)clock_gettime(CLOCK_MONOTONIC, &t1);
+    bits_usec = elapsed_usec(&t0, &t1);
+
+    printf ("table lookup: %8.1f chars/us\n", 
+            BENCH_FRAMES * tempstring_len / table_usec);
+    printf ("bit testing:  %8.1f chars/us\n", 
+            BENCH_FRAMES * tempstring_len / bits_usec);
+    return 0;
+}
+
+#endif /* TEXT_BENCH_PROGRAM */
@@ -37,6 +37,7 @@
 /* types defined in photo.c */
 typedef struct photo_t photo_t;
 typedef struct image_t image_t;
+typedef struct image_span_t image_span_t;
 
 /* types defined in world.h */
 typedef struct room_t room_t;
@@ -0,0 +1,193 @@
+/*									tab:8
+ *
+ * wheel.c - hierarchical timer wheel for the adventure game
+ *
+ * Filename:	    wheel.c
+ *
+ * Timers wait in one of WHEEL_LEVELS wheels of WHEEL_SIZE slots.  Level 0
+ * holds timers due within WHEEL_SIZE ticks, one slot per tick; each slot
+ * of level L spans WHEEL_SIZE^L ticks.  A timer goes in the lowest level
+ * that reaches its expiration tick, in the slot given by that level's
+ * digit of the tick.  Whenever level L's digit of the current tick wraps
+ * to 0, the timers in level L+1's current slot are cascaded: reinserted,
+ * which moves them down at least one level.  Scheduling and cancelling
+ * thus take constant time, and each tick touches only one level 0 slot
+ * (plus a cascade every WHEEL_SIZE ticks).  Timers due beyond the top
+ * level's reach wait in its last slot and are reinserted until due.
+ */
+
+#include "wheel.h"
+
+
+#define WHEEL_BITS   6                   /* log2 of slots per level  */
+#define WHEEL_SIZE   (1 << WHEEL_BITS)   /* slots per level          */
+#define WHEEL_MASK   (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4                   /* levels: 2^24 ticks reach */
+
+
+/* local functions--see function headers for details */
+static void insert_timer (wheel_timer_t* t);
+static void move_slot (wheel_timer_t** from, wheel_timer_t** to);
+
+
+/* file-scope variables */
+static uint64_t now = 0;                  /* ticks since program start */
+static wheel_timer_t* slot[WHEEL_LEVELS][WHEEL_SIZE]; /* timer lists   */
+
+
+/*
+ * wheel_schedule
+ *   DESCRIPTION: Schedule a timer's callback to run from wheel_advance
+ *                after a number of ticks.  If the timer is already
+ *                scheduled, its earlier schedule is cancelled.
+ *   INPUTS: t -- the timer (with callback and argument set)
+ *           ticks -- ticks from now (0 is treated as 1)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: links t into the wheel
+ */
+void
+wheel_schedule (wheel_timer_t* t, uint32_t ticks)
+{
+    wheel_cancel (t);
+    t->expires = now + (0 == ticks ? 1 : ticks);
+    insert_timer (t);
+}
+
+
+/*
+ * wheel_cancel
+ *   DESCRIPTION: Stop a timer if it is scheduled.
+ *   INPUTS: t -- the timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: unlinks t from the wheel
+ */
+void
+wheel_cancel (wheel_timer_t* t)
+{
+    if (NULL == t->pprev) {
+        return;
+    }
+    if (NULL != (*t->pprev = t->next)) {
+        t->next->pprev = t->pprev;
+    }
+    t->pprev = NULL;
+}
+
+
+/*
+ * wheel_pending
+ *   DESCRIPTION: Check whether a timer is scheduled.
+ *   INPUTS: t -- the timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the timer is scheduled, 0 if it is idle
+ *   SIDE EFFECTS: none
+ */
+int32_t
+wheel_pending (const wheel_timer_t* t)
+{
+    return (NULL != t->pprev);
+}
+
+
+/*
+ * wheel_advance
+ *   DESCRIPTION: Advance the wheel tick by tick, cascading timers down
+ *                the levels and running the callbacks of timers that
+ *                come due.  Timers are idle when their callbacks run, and
+ *                timers scheduled by callbacks run no earlier than the
+ *                next tick.
+ *   INPUTS: ticks -- number of ticks that have passed
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: runs callbacks
+ */
+void
+wheel_advance (uint32_t ticks)
+{
+    wheel_timer_t* due;  /* timers due this tick              */
+    wheel_timer_t* t;    /* a timer being cascaded or run     */
+    int32_t        lev;  /* level being cascaded              */
+    uint64_t       idx;  /* slot index at level being cascaded */
+
+    while (0 < ticks--) {
+	now++;
+
+	/* Cascade each level whose lower neighbor has wrapped around. */
+	for (lev = 1; WHEEL_LEVELS > lev; lev++) {
+	    if (0 != ((now >> ((lev - 1) * WHEEL_BITS)) & WHEEL_MASK)) {
+	        break;
+	    }
+	    idx = (now >> (lev * WHEEL_BITS)) & WHEEL_MASK;
+	    move_slot (&slot[lev][idx], &due);
+	    while (NULL != (t = due)) {
+		wheel_cancel (t);
+		insert_timer (t);
+	    }
+	}
+
+	/* 
+	 * Run the timers due now.  They stay linked in the list due until 
+	 * run, so that callbacks can cancel or reschedule them.
+	 */
+	move_slot (&slot[0][now & WHEEL_MASK], &due);
+	while (NULL != (t = due)) {
+	    wheel_cancel (t);
+	    (*t->fn) (t->arg);
+	}
+    }
+}
+
+
+/*
+ * insert_timer
+ *   DESCRIPTION: Link an idle timer into the slot for its expiration
+ *                tick, which must be after the current tick.
+ *   INPUTS: t -- the timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: links t into the wheel
+ */
+static void
+insert_timer (wheel_timer_t* t)
+{
+    uint64_t delta = t->expires - now; /* ticks until due    */
+    uint64_t when = t->expires;        /* tick used for slot */
+    int32_t  lev;                      /* level of slot      */
+    wheel_timer_t** head;              /* the slot           */
+
+    for (lev = 0; WHEEL_LEVELS - 1 > lev; lev++) {
+	if ((1ULL << ((lev + 1) * WHEEL_BITS)) > delta) {
+	    break;
+	}
+    }
+    if ((1ULL << (WHEEL_LEVELS * WHEEL_BITS)) <= delta) {
+	/* Too far away: wait as long as possible, then reinsert. */
+        when = now + (1ULL << (WHEEL_LEVELS * WHEEL_BITS)) - 1;
+    }
+    head = &slot[lev][(when >> (lev * WHEEL_BITS)) & WHEEL_MASK];
+    if (NULL != (t->next = *head)) {
+        t->next->pprev = &t->next;
+    }
+    *head = t;
+    t->pprev = head;
+}
+
+
+/*
+ * move_slot
+ *   DESCRIPTION: Move all timers from a slot to an empty list head.
+ *   INPUTS: from -- the slot
+ *   OUTPUTS: to -- the list head
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: empties the slot
+ */
+static void
+move_slot (wheel_timer_t** from, wheel_timer_t** to)
+{
+    if (NULL != (*to = *from)) {
+        (*to)->pprev = to;
+    }
+    *from = NULL;
+}
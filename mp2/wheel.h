@@ -0,0 +1,50 @@
+/*									tab:8
+ *
+ * wheel.h - header file for the adventure game's timer wheel
+ *
+ * Filename:	    wheel.h
+ */
+
+#ifndef WHEEL_H
+#define WHEEL_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * The timer wheel runs callbacks after a given number of game ticks.  It
+ * belongs to the game logic thread: all functions must be called from
+ * that thread, and callbacks run there (from wheel_advance).  Timers are
+ * owned by the caller and may be scheduled again, or cancelled, at any
+ * time--including by their own callbacks.
+ */
+
+typedef void (*wheel_fn_t) (void* arg);
+
+typedef struct wheel_timer_t wheel_timer_t;
+struct wheel_timer_t {
+    wheel_timer_t*  next;    /* next timer in wheel slot                */
+    wheel_timer_t** pprev;   /* pointer to this timer, or NULL if idle  */
+    uint64_t        expires; /* tick at which callback runs             */
+    wheel_fn_t      fn;      /* callback                                */
+    void*           arg;     /* argument passed to callback             */
+};
+
+/* initializer for an idle timer */
+#define WHEEL_TIMER_INIT(fn,arg) {NULL, NULL, 0, (fn), (arg)}
+
+/* Run a timer's callback in ticks ticks (at least 1), rescheduling it. */
+extern void wheel_schedule (wheel_timer_t* t, uint32_t ticks);
+
+/* Stop a timer if it is scheduled. */
+extern void wheel_cancel (wheel_timer_t* t);
+
+/* Check whether a timer is scheduled (1) or idle (0). */
+extern int32_t wheel_pending (const wheel_timer_t* t);
+
+/* Advance the wheel by ticks ticks, running callbacks as they come due. */
+extern void wheel_advance (uint32_t ticks);
+
+#endif /* WHEEL_H */
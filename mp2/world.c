@@ -34,125 +34,23 @@
  */
  
 
+#include <ctype.h>
+#include <fcntl.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "assert.h"
+#include "pack.h"
 #include "photo.h"
 #include "world.h"
+#include "world_headers.h"
 
 
 /* parameters defined for this file */
 
-/* room identifiers */
-enum {
-    R_NONE = -1,
-
-    /* Area 0: The Backpack */
-    R_INVENTORY,
-
-    /* Area 1: Everitt and Green Street */
-    R_IN_391LAB,	/* inside the 391 lab               */
-    R_BY_391LAB,	/* outside of the 391 lab           */
-    R_IN_IEEE,		/* inside the IEEE/HKN office       */
-    R_BY_IEEE,		/* outside of the IEEE/HKN office   */
-    R_IN_395LAB,	/* inside the 395 lab               */
-    R_BY_395LAB,	/* outside of the 395 lab           */
-    R_EVT_STAIR,	/* Everitt Lab's eastern stairwell  */
-    R_IN_CLEANR,	/* inside the cleanroom             */
-    R_BY_CLEANR,	/* outside of the cleanroom         */
-    R_EVRT_VEND,	/* near the Everitt vending machine */
-    R_ALMAMATER,	/* near the Alma Mater statue       */
-    R_IN_COCOMR,	/* inside of Cocomero               */
-    R_BY_COCOMR,	/* just outside of Cocomero         */
-    R_BY_ZAS,		/* across from the ruins of Za's    */
-    R_EAST_EVRT,	/* East entrance of Everitt Lab     */
-    R_EVRT_BSMT,	/* entrance to Everitt Lab basement */
-
-    /* Area 2: Bardeen Quad and Environs */
-    R_WEST_BONE,	/* looking West along the Boneyard   */
-    R_CIRCLE_N,		/* Boneyard Bridge looking North     */
-    R_CIRCLE_SW,	/* Boneyard Bridge looking Southwest */
-    R_EAST_BONE,	/* looking East along the Boneyard   */
-    R_BARDEEN,		/* Bardeen Quad                      */
-    R_LIB_BACK,		/* rear of Grainger library          */
-    R_RESERVE,		/* Grainger reserve desk             */
-    R_TALBOT_NW,	/* looking Northwest at Talbot       */
-    R_TALBOT_SW,	/* looking Southwest at Talbot       */
-    R_TALBOT,		/* inside Talbot Laboratory          */
-    R_SPRINGFLD,	/* looking West along Springfield    */
-    R_CARIBOU,		/* the Caribou coffee shop           */
-    R_KENNEY,		/* Kenney Gym                        */
-    R_DCL,		/* Digital Computer Laboratory       */
-    R_LIB_FRONT,	/* front of Grainger library         */
-
-    /* Area 3: CSL and Environs */
-    R_KENNEY_E,		/* East of Kenney Gym                */
-    R_NEWMARK,		/* Newmark Laboratory                */
-    R_MNTL_NW,		/* looking Northwest at MNTL         */
-    R_MNTL_SW,		/* looking Southwest at MNTL         */
-    R_MNTLLOBBY,	/* the lobby of MNTL                 */
-    R_MNTL_LAB1,	/* a laboratory within MNTL (#1)     */
-    R_MNTL_LAB2,	/* a laboratory within MNTL (#2)     */
-    R_MNTL_LAB3,	/* a laboratory within MNTL (#3)     */
-    R_CSL_VIEW, 	/* Coordinated Science Laboratory    */
-    R_CSL_DOOR,		/* the CSL main entrance             */
-    R_CSL_LOBBY,	/* in the CSL lobby                  */
-    R_CSL_UPPER,	/* on an upper floor of CSL          */
-    R_CSLLOUNGE,	/* in the new CSL lounge area        */
-    R_BECK_LOT,		/* the Beckman Circle parking lot    */
-    R_BECKMAN,		/* the Beckman Institute             */
-    R_BECK_DOOR,	/* Beckman main entrance             */
-    R_BECKLOBBY,	/* in the lobby of Beckman           */
-    R_BECK_MRI,		/* an MRI machine ... somewhere      */
-
-    /* Area 4: The Rest of the World, Featuring the Remote Sensing Lab */
-    R_GARAGE,		/* the campus parking structure      */
-    R_CAR_SITE,		/* the (fictitious) ECE391 car       */
-    R_ALLERTON,		/* the Allerton mansion              */
-    R_FU_DOGS,		/* the Fu dogs at Allerton           */
-    R_STATUE,		/* a statue near the Fu dogs         */
-    R_SUNSINGER,	/* the Allerton Sun Singer statue    */
-    R_WILLARD,		/* Willard Airport fountain view     */
-    R_WILL_SIDE,	/* side view of Willard and tower    */
-    R_REM_PLANE,	/* a sensor-laden plane              */
-    R_COCKPIT,		/* cockpit of remote sensing plane   */
-    R_OVER_WILL,	/* flying above Willard Airport      */ 
-    R_AIR_RIO,		/* view of Rio de Janeiro from air   */
-    R_REM_ICE,		/* the ice fields near rem. sen. lab */
-    R_REM_LAB,		/* part of a remote sensing lab      */
-
-    N_ROOMS
-};
-
-/* object identifiers */
-enum {
-    O_NONE = -1,
-
-    O_BOARD,		/* a motorized mountain board                 */
-    O_JETPACK,		/* Buzz Lightyear: to Infinity ...            */
-    O_TUX,		/* Tux: our mascot                            */
-    O_MP2,		/* the MP2 specification (covers mode X)      */
-    O_BOOK_C,		/* the C programming language                 */
-    O_BOOK_WODE,	/* stories by P.G. Wodehouse                  */
-    O_GPS_BAD,		/* a malfunctioning GPS device                */
-    O_GPS_GOOD,		/* a working GPS device                       */
-    O_GPS_SPEC,		/* GPS chip data sheet (specifications)       */
-    O_BUNNYSUIT,	/* a pink bunny suit                          */
-    O_BATT_EMPTY,	/* an uncharged car battery                   */
-    O_BATT_FULL,	/* a fully charged car battery                */
-    O_BATT_CAR,		/* battery as it appears in the car           */
-    O_MTN_DEW,		/* a bottle of dew                            */
-    O_FISH,		/* a fish to lure penguins                    */
-    O_ICARD,		/* an I-card                                  */
-    O_CAR_KEY,		/* the keys to a car                          */
-    O_ROBOT_DEAD,	/* a buggy lockpicking robot                  */
-    O_ROBOT_LIVE,	/* lockpicking robot with new control program */
-    O_MIMO_CARD,	/* a MIMO card for planes                     */
-
-    N_OBJECTS
-};
-
 /* flag identifiers for recording the player's accomplishments */
 enum {
     FLAG_HAS_EATEN,	/* player has eaten something         */
@@ -163,29 +61,41 @@ enum {
     NUM_FLAGS
 };
 
-/* identifiers for rooms with photo swapping */
-enum {
-    SWAP_CIRCLE,	/* Boneyard Creek Bridge photo swap */
-    SWAP_CAR,		/* open/closed hood                 */
-    N_SWAPS
-};
-
-
 /* types local to this file (declared in types.h) */
 
+/*
+ * A room photo, which is read from its file only when first needed (see
+ * get_photo).  Its size is known from the world file without reading it.
+ */
+typedef struct photo_ref_t photo_ref_t;
+struct photo_ref_t {
+    const char* file;		/* photo file name                */
+    uint16_t    width;		/* photo size in pixels           */
+    uint16_t    height;
+    photo_t*    photo;		/* the photo, or NULL if not read */
+};
+
 /*
  * The structure representing a room in the world.  The backpack/inventory 
  * is also a 'room' (#0, R_INVENTORY). 
  */
 struct room_t {
     const char* name;		/* name of room                   */
-    photo_t*    view;		/* photo currently shown for room */
+    photo_ref_t view;		/* photo currently shown for room */
     object_t*   contents; 	/* linked list of objects in room */
     room_t*     left;   	/* room to the "left"             */
     room_t*     enter;  	/* doors, etc.                    */
     room_t*     right;  	/* room to the "right"            */
+    int32_t     n_dirty;	/* number of changed regions, or  */
+    				/*   DIRTY_ALL for the whole room */
+    rect_t      dirty[MAX_DIRTY_RECTS]; /* changed regions of photo */
+    int32_t     stale;		/* 1 if shown must be rebuilt     */
+    room_view_t shown;		/* photo and contents for drawing */
 };
 
+/* value of n_dirty when the whole room photo must be redrawn */
+#define DIRTY_ALL (-1)
+
 /*
  * The structure representing an object in the world.  Objects are
  * unique, which prevents players from drinking too much Dew (they're
@@ -194,237 +104,47 @@ struct room_t {
 struct object_t {
     const char*  name;		/* name of object                 */
     object_t*    next;		/* linked list of room contents   */
+    object_t*    name_next;	/* chain in name index            */
+    uint32_t     name_hash;	/* hash of case-folded name       */
     room_t*      loc;      	/* in what 'room'?                */
     uint16_t     x, y;    	/* location within room photo     */
-    image_t*     img;     	/* image for use in room          */
+    uint16_t     w, h;		/* image size in pixels           */
+    const char*  file;		/* image file name                */
+    image_t*     img;     	/* image for use in room, or NULL */
+    				/*   until needed (see get_image) */
 };
 
 /*
- * This local structure is used to specify room connectivity and data 
- * in a reasonably manageable way.  The array entries in the database
- * specify the room id, name, filename, and connections to other
- * rooms by symbolic name.  Since there are many rooms, trying to
- * keep the order between the enumeration of symbolic names and the
- * array entries can be tricky.  Instead, we associate array entries
- * with specific symbolic names using the id field.  Thus, you can
- * reorder the entries in the room_data array without affecting their
- * meaning.
+ * Objects in rooms (including the inventory) are also indexed by room and
+ * case-folded name, so that typed commands can find an object without
+ * scanning the room's contents.  Each object with a location is linked 
+ * into the chain (through name_next) of the bucket chosen by its room and
+ * name_hash; see name_chain.
  */
-typedef struct room_data_t room_data_t;
-struct room_data_t {
-    int32_t           id;	/* id of room being described    */
-    const char* const name;	/* name of room                  */
-    const char* const filename;	/* file name for room photo      */
-    int32_t           left;	/* id of room to 'left'          */
-    int32_t           enter;	/* id of room reached by 'enter' */
-    int32_t           right;	/* id of room to 'right'         */
-};
-
-/* the room connectivity data */
-static const room_data_t room_data[N_ROOMS] = {
-    /* Area 0: The Backpack */
-    {R_INVENTORY, "Inventory", "images/backpack.photo", 
-                       R_NONE,      R_NONE,      R_NONE},
-
-    /* Area 1: Everitt and Green Street */
-    {R_IN_391LAB, "391 Lab", "images/391lab.photo", 
-                       R_NONE, R_BY_391LAB,      R_NONE},
-    {R_BY_391LAB, "Outside of 391", "images/outside391.photo", 
-                     R_BY_ZAS, R_IN_391LAB,   R_BY_IEEE},
-    {  R_IN_IEEE, "IEEE Office", "images/ieee.photo", 
-                       R_NONE,   R_BY_IEEE,      R_NONE},
-    {  R_BY_IEEE, "Outside IEEE", "images/byieee.photo", 
-                  R_BY_391LAB,   R_IN_IEEE, R_BY_395LAB},
-    {R_IN_395LAB, "395 Lab", "images/395lab.photo", 
-                       R_NONE, R_BY_395LAB,      R_NONE},
-    {R_BY_395LAB, "Outside of 395", "images/outside395.photo", 
-                    R_BY_IEEE,      R_NONE, R_EVT_STAIR},
-    {R_EVT_STAIR, "Everitt Stairs", "images/evtstair.photo", 
-                  R_BY_395LAB, R_EAST_EVRT, R_BY_CLEANR},
-    {R_IN_CLEANR, "In Cleanroom", "images/cleanr.photo", 
-                       R_NONE, R_BY_CLEANR,      R_NONE},
-    {R_BY_CLEANR, "By the Cleanroom", "images/outclean.photo", 
-                  R_EVT_STAIR,      R_NONE, R_EVRT_VEND},
-    {R_EVRT_VEND, "Vending Machine", "images/vend.photo", 
-                  R_BY_CLEANR, R_EVRT_BSMT,      R_NONE},
-    {R_ALMAMATER, "Alma Mater", "images/almamater.photo", 
-                  R_EAST_EVRT, R_EAST_EVRT, R_BY_COCOMR},
-    {R_IN_COCOMR, "Cocomero", "images/incoco.photo", 
-                       R_NONE, R_BY_COCOMR,      R_NONE},
-    {R_BY_COCOMR, "Near Cocomero", "images/bycoco.photo", 
-                  R_ALMAMATER, R_IN_COCOMR,    R_BY_ZAS},
-    {R_BY_ZAS, "The Ruins", "images/ruins.photo", 
-                  R_BY_COCOMR,      R_NONE,      R_NONE},
-    {R_EAST_EVRT, "East of Everitt", "images/eeast.photo", 
-                  R_ALMAMATER, R_EVT_STAIR, R_EVRT_BSMT},
-    {R_EVRT_BSMT, "Basement Entry", "images/basement.photo", 
-                  R_EAST_EVRT, R_EVRT_VEND, R_CIRCLE_SW},
-
-    /* Area 2: Bardeen Quad and Environs */
-    {R_WEST_BONE, "Boneyard Creek", "images/bonew.photo", 
-                  R_CIRCLE_SW,      R_NONE,  R_CIRCLE_N},
-    { R_CIRCLE_N, "Boneyard Bridge", "images/circlen1.photo", 
-                  R_WEST_BONE, R_TALBOT_NW, R_EAST_BONE},
-    {R_CIRCLE_SW, "Boneyard Bridge", "images/circlesw.photo", 
-                  R_EAST_BONE, R_EVRT_BSMT,  R_CIRCLE_N},
-    {R_EAST_BONE, "Boneyard Creek", "images/bonee.photo", 
-                   R_CIRCLE_N,      R_NONE, R_CIRCLE_SW},
-    {  R_BARDEEN, "Bardeen Quad", "images/bardeen.photo", 
-                   R_LIB_BACK, R_EAST_BONE, R_TALBOT_SW},
-    { R_LIB_BACK, "Grainger Library", "images/graingerback.photo", 
-                        R_DCL,   R_RESERVE,   R_BARDEEN},
-    {  R_RESERVE, "Grainger Reserves", "images/reserve.photo", 
-                       R_NONE,  R_LIB_BACK, R_LIB_FRONT},
-    {R_TALBOT_NW, "Talbot Lab", "images/talbotnw.photo", 
-                  R_CIRCLE_SW,    R_TALBOT, R_TALBOT_SW},
-    {R_TALBOT_SW, "Talbot Lab", "images/talbotsw.photo", 
-                  R_TALBOT_NW,    R_TALBOT, R_SPRINGFLD},
-    {   R_TALBOT, "Talbot Lab", "images/talbot.photo", 
-                       R_NONE, R_TALBOT_NW,      R_NONE},
-    {R_SPRINGFLD, "Springfield Avenue", "images/springfield.photo", 
-                  R_TALBOT_SW,   R_CARIBOU,    R_KENNEY},
-    {  R_CARIBOU, "Caribou", "images/caribou.photo", 
-                       R_NONE, R_SPRINGFLD,      R_NONE},
-    {   R_KENNEY, "Kenney Gym", "images/kenney.photo", 
-                  R_SPRINGFLD,      R_NONE,       R_DCL},
-    {      R_DCL, "DCL", "images/dcl.photo", 
-                     R_KENNEY,  R_KENNEY_E, R_LIB_FRONT},
-    {R_LIB_FRONT, "Grainger Library", "images/graingerfront.photo", 
-                        R_DCL,   R_RESERVE, R_TALBOT_SW},
-
-    /* Area 3: CSL and Environs */
-    { R_KENNEY_E, "East of Kenney", "images/kenneye.photo", 
-                        R_DCL,       R_DCL,   R_NEWMARK},
-    {  R_NEWMARK, "Newmark Lab", "images/newmark.photo", 
-                    R_MNTL_NW,      R_NONE,  R_KENNEY_E},
-    {  R_MNTL_NW, "MNTL", "images/mntlnw.photo", 
-                    R_NEWMARK, R_MNTLLOBBY,  R_CSL_VIEW},
-    {  R_MNTL_SW, "MNTL", "images/mntlsw.photo", 
-                    R_MNTL_NW, R_MNTLLOBBY,   R_BECKMAN},
-    {R_MNTLLOBBY, "Lobby of MNTL", "images/mntllobby.photo", 
-                  R_MNTL_LAB1,   R_MNTL_SW, R_MNTL_LAB2},
-    {R_MNTL_LAB1, "Kevin's Lab in MNTL", "images/mntllab1.photo", 
-                       R_NONE,      R_NONE, R_MNTLLOBBY},
-    {R_MNTL_LAB2, "MNTL Laser Lab", "images/mntllab2.photo", 
-                  R_MNTLLOBBY, R_MNTL_LAB3,      R_NONE},
-    {R_MNTL_LAB3, "MNTL Laser Lab", "images/mntllab3.photo", 
-                       R_NONE, R_MNTL_LAB2,      R_NONE},
-    { R_CSL_VIEW, "CSL", "images/csl.photo", 
-                   R_BECK_LOT,  R_CSL_DOOR,   R_MNTL_NW},
-    { R_CSL_DOOR, "CSL Main Entrance", "images/csldoor.photo", 
-                   R_BECK_LOT,      R_NONE,   R_MNTL_NW},
-    {R_CSL_LOBBY, "CSL Lobby", "images/csllobby.photo", 
-                  R_CSL_UPPER,  R_CSL_DOOR,      R_NONE},
-    {R_CSL_UPPER, "Upper Floor of CSL", "images/cslupper.photo", 
-                       R_NONE, R_CSLLOUNGE, R_CSL_LOBBY},
-    {R_CSLLOUNGE, "CSL Lounge", "images/csllounge.photo", 
-                       R_NONE, R_CSL_UPPER,      R_NONE},
-    { R_BECK_LOT, "Beckman Circle Lot", "images/becklot.photo", 
-                    R_BECKMAN,    R_GARAGE,  R_CSL_VIEW},
-    {  R_BECKMAN, "Beckman Institute", "images/beckman.photo", 
-                    R_MNTL_SW, R_BECK_DOOR,  R_BECK_LOT},
-    {R_BECK_DOOR, "Beckman Institute", "images/beckdoor.photo", 
-                    R_MNTL_SW,      R_NONE,  R_BECK_LOT},
-    {R_BECKLOBBY, "Beckman Lobby", "images/becklobby.photo", 
-                       R_NONE,  R_BECK_MRI, R_BECK_DOOR},
-    { R_BECK_MRI, "An MRI Lab", "images/beckmri.photo", 
-                       R_NONE, R_BECKLOBBY,      R_NONE},
-
-    /* Area 4: The Rest of the World, Featuring the Remote Sensing Lab */
-    {   R_GARAGE, "Campus Parking", "images/garage.photo", 
-                   R_BECK_LOT,  R_CAR_SITE,      R_NONE},
-    { R_CAR_SITE, "Use Someone's Car?", "images/carclosed.photo", 
-                       R_NONE,    R_GARAGE,      R_NONE},
-    { R_ALLERTON, "Allerton Mansion", "images/allerton.photo", 
-                    R_FU_DOGS,      R_NONE, R_SUNSINGER},
-    {  R_FU_DOGS, "Fu Dog Statues", "images/fudogs.photo", 
-                       R_NONE,    R_STATUE,  R_ALLERTON},
-    {   R_STATUE, "A Tall Statue", "images/statue.photo", 
-                       R_NONE,   R_FU_DOGS,      R_NONE},
-    {R_SUNSINGER, "The Sun Singer", "images/sunsinger.photo", 
-                   R_ALLERTON,      R_NONE,      R_NONE},
-    {  R_WILLARD, "Willard Airport", "images/willard.photo", 
-                       R_NONE, R_WILL_SIDE,      R_NONE},
-    {R_WILL_SIDE, "Willard Tower", "images/willardside.photo", 
-                  R_REM_PLANE,      R_NONE,   R_WILLARD},
-    {R_REM_PLANE, "Sensor-Laden Plane", "images/rsenseplane.photo", 
-                    R_COCKPIT,      R_NONE, R_WILL_SIDE},
-    {  R_COCKPIT, "Plane Cockpit", "images/cockpit.photo", 
-                       R_NONE,      R_NONE, R_REM_PLANE},
-    {R_OVER_WILL, "Flying over Willard", "images/overwillard.photo", 
-                       R_NONE,   R_COCKPIT,   R_AIR_RIO},
-    {  R_AIR_RIO, "Rio de Janeiro", "images/riofromair.photo", 
-                  R_OVER_WILL,      R_NONE,   R_REM_ICE},
-    {  R_REM_ICE, "Ice Fields", "images/rsenseice.photo", 
-                    R_AIR_RIO,   R_REM_LAB,      R_NONE},
-    {  R_REM_LAB, "Remote Sensing Lab", "images/rsenselab.photo", 
-                       R_NONE,   R_REM_ICE,      R_NONE}
-};
+#define NAME_BUCKETS 64		/* chains in name index (a power of 2) */
 
 /*
- * This local structure is used to specify object information in a 
- * reasonably manageable way.  The array entries in the database specify 
- * the object id, name, filename, starting room (if any), and starting 
- * location * within that room (if not random).  We use this approach for 
- * the same * reason as with the rooms: to avoid the need to match the 
- * order between the enumeration of symbolic names and the array entries.
+ * Rooms, objects, room photos, and object images live as long as the
+ * world, so they are allocated from one arena in big chunks (backed by
+ * transparent huge pages if WORLD_HUGE_PAGES is 1) and freed all at once
+ * by free_world.
  */
-typedef struct obj_data_t obj_data_t;
-struct obj_data_t {
-    int32_t id;			/* object identifier                   */
-    const char* const name;	/* object keyword                      */
-    const char* const filename; /* object image file name              */
-    int32_t room;		/* starting room or R_NONE             */
-    int32_t x;			/* starting x position (-1 for random) */
-    int32_t y;			/* starting y position                 */
-};
-
-/* the object positioning data */
-static const obj_data_t obj_data[N_OBJECTS] = {
-    {     O_BOARD, "board", "images/board.obj", R_IN_IEEE, -1, -1},
-    {   O_JETPACK, "jetpack", "images/jetpack.obj", R_TALBOT, -1, -1},
-    {       O_TUX, "tux", "images/tux.obj", R_REM_LAB, 250, 100},
-    {       O_MP2, "mp2", "images/mp2.obj", R_CSLLOUNGE, -1, -1},
-    {    O_BOOK_C, "book", "images/book.obj", R_NONE, -1, -1},
-    { O_BOOK_WODE, "book", "images/book2.obj", R_NONE, -1, -1},
-    {   O_GPS_BAD, "gps", "images/gpsbad.obj", R_TALBOT, -1, -1},
-    {  O_GPS_GOOD, "gps", "images/gpsgood.obj", R_NONE, -1, -1},
-    {  O_GPS_SPEC, "spec", "images/gpsspec.obj", R_CSL_UPPER, -1, -1},
-    { O_BUNNYSUIT, "bunnysuit", "images/bunnysuit.obj", R_ALMAMATER, 230, 250},
-    {O_BATT_EMPTY, "battery", "images/battery.obj", R_NONE, -1, -1},
-    { O_BATT_FULL, "battery", "images/battery.obj", R_NONE, -1, -1},
-    {  O_BATT_CAR, "battery", "images/batteryincar.obj", R_NONE, -1, -1},
-    {   O_MTN_DEW, "dew", "images/dew.obj", R_NONE, -1, -1},
-    {      O_FISH, "fish", "images/fish.obj", R_EAST_BONE, 80, 260},
-    {     O_ICARD, "Icard", "images/icard.obj", R_BARDEEN, -1, -1},
-    {   O_CAR_KEY, "key", "images/key.obj", R_CARIBOU, -1, -1},
-    {O_ROBOT_DEAD, "robot", "images/robot.obj", R_MNTL_LAB3, -1, -1},
-    {O_ROBOT_LIVE, "robot", "images/robot.obj", R_NONE, -1, -1},
-    { O_MIMO_CARD, "mimo", "images/mimo.obj", R_STATUE, -1, -1}
-};
-
-/*
- * Some rooms alternate between two photos.  For these rooms, we load the
- * image data for both photos once, but need an extra pointer in order to
- * keep track of the photo currently swapped out.  We use these swap data
- * to name and describe these extra photos.
- */
-typedef struct swap_data_t swap_data_t;
-struct swap_data_t {
-    int32_t id;
-    const char* const filename;
-};
-
-/* the swap photo descriptions */
-static const swap_data_t swap_data[N_SWAPS] = {
-    {SWAP_CIRCLE, "images/circlen2.photo"},	/* alternate for Boneyard */
-    {SWAP_CAR, "images/caropen.photo"}		/* open/closed car photos */
-};
-
+#define WORLD_CHUNK_SIZE (4 << 20)	/* usual arena chunk size in bytes */
+#define WORLD_HUGE_PAGES 1		/* 1 to ask for huge pages         */
 
 /* functions local to this file--see function headers for details */
 static void do_photo_swap (room_t* r, int32_t which);
 static object_t* find_in_room (const room_t* r, const char* arg);
+static uint32_t hash_name (const char* name);
+static object_t** name_chain (const room_t* r, uint32_t hash);
+static void mark_dirty (room_t* r, const object_t* o);
+static photo_t* get_photo (photo_ref_t* ref);
+static image_t* get_image (object_t* o);
+static void sync_view (room_t* r);
+static const world_header_t* map_world (const char* fname);
+static int32_t bad_string (uint32_t off);
+static int32_t bad_room_id (int32_t id);
+static void set_photo_ref (photo_ref_t* ref, const world_photo_t* wp);
 static void insert_object_at (object_t* o, room_t* r, int32_t x, int32_t y);
 static void insert_object (object_t* o, room_t* r);
 static void move_object_to_inventory (object_t* obj);
@@ -440,10 +160,21 @@ static void remove_object (object_t* o);
  * overkill for this game, but it's nice not to worry about the number of 
  * flags...
  */
-static room_t   room[N_ROOMS];			     /* rooms                */
-static object_t object[N_OBJECTS];		     /* objects              */
+static room_t*  room = NULL;			     /* rooms (world_arena)  */
+static int32_t  n_rooms;			     /* number of rooms      */
+static object_t* object = NULL;			     /* objects (ditto)      */
+static int32_t  n_objects;			     /* number of objects    */
 static uint32_t player_flags[(NUM_FLAGS + 31) / 32]; /* accomplishment flags */
-static photo_t* swap_photo[N_SWAPS];                 /* swapping photos      */
+static photo_ref_t swap_photo[N_SWAPS];              /* swapping photos      */
+static object_t* name_index[NAME_BUCKETS];	     /* objects by name      */
+static arena_t  world_arena =			     /* rooms and images     */
+    ARENA_INIT (WORLD_CHUNK_SIZE, WORLD_HUGE_PAGES);
+
+/* the mapped world file (see world_headers.h) */
+static const uint8_t* world_map = NULL;		     /* mapping or NULL      */
+static size_t         world_size;		     /* bytes mapped         */
+static const char*    world_str;		     /* its string table     */
+static uint32_t       world_str_size;		     /* bytes in table       */
 
 
 /* 
@@ -458,12 +189,16 @@ static photo_t* swap_photo[N_SWAPS];                 /* swapping photos      */
 static void
 do_photo_swap (room_t* r, int32_t which)
 {
-    photo_t* tmp;	/* temporary variable to help with swap */
+    photo_ref_t tmp;	/* temporary variable to help with swap */
 
-    /* Swap the photos. */
+    /* Swap the photos (neither of which need have been read yet). */
     tmp               = r->view;
     r->view           = swap_photo[which];
     swap_photo[which] = tmp;
+    r->stale = 1;
+
+    /* Everything in the room may have changed. */
+    r->n_dirty = DIRTY_ALL;
 }
 
 
@@ -471,6 +206,9 @@ do_photo_swap (room_t* r, int32_t which)
  * find_in_room
  *   DESCRIPTION: Find an object by name in a room.  The name must match
  *                exactly, although the match is not sensitive to case.
+ *                If several objects match, the one added to the room last
+ *                is found.  Looks only at the room's chain in the name
+ *                index, not at all of its contents.
  *   INPUTS: r -- the room in which to look
  *           arg -- the name of the object (a string)
  *   OUTPUTS: none
@@ -480,13 +218,15 @@ do_photo_swap (room_t* r, int32_t which)
 static object_t* 
 find_in_room (const room_t* r, const char* arg)
 {
-    object_t* obj;	/* index over room contents */
+    uint32_t  hash = hash_name (arg); /* hash of name sought           */
+    object_t* obj;		      /* index over objects in chain   */
 
-    /* Loop over objects in room. */
-    for (obj = r->contents; NULL != obj; obj = obj->next) {
+    /* Loop over objects in the name index chain for the room and name. */
+    for (obj = *name_chain (r, hash); NULL != obj; obj = obj->name_next) {
 
 	/* If we find a matching object, return it. */
-        if (0 == strcasecmp (arg, obj->name)) {
+        if (r == obj->loc && hash == obj->name_hash &&
+	    0 == strcasecmp (arg, obj->name)) {
 	    return obj;
 	}
     }
@@ -496,6 +236,45 @@ find_in_room (const room_t* r, const char* arg)
 }
 
 
+/* 
+ * hash_name
+ *   DESCRIPTION: Hash an object name without regard to case (FNV-1a over
+ *                the lower-case characters).
+ *   INPUTS: name -- the name
+ *   OUTPUTS: none
+ *   RETURN VALUE: the hash value
+ *   SIDE EFFECTS: none
+ */
+static uint32_t
+hash_name (const char* name)
+{
+    uint32_t hash = 2166136261U; /* hash of characters so far */
+
+    for (; '\0' != *name; name++) {
+        hash = (hash ^ (uint8_t)tolower ((uint8_t)*name)) * 16777619U;
+    }
+    return hash;
+}
+
+
+/* 
+ * name_chain
+ *   DESCRIPTION: Find the name index chain that holds the objects in a
+ *                room with a given name hash (and perhaps others).
+ *   INPUTS: r -- the room
+ *           hash -- the name hash (see hash_name)
+ *   OUTPUTS: none
+ *   RETURN VALUE: a pointer to the head of the chain
+ *   SIDE EFFECTS: none
+ */
+static object_t**
+name_chain (const room_t* r, uint32_t hash)
+{
+    return &name_index[(hash + (uint32_t)(r - room) * 0x9E3779B1U) & 
+		       (NAME_BUCKETS - 1)];
+}
+
+
 /* 
  * insert_object_at
  *   DESCRIPTION: Place an object at a specific (x,y) location in a room.
@@ -512,6 +291,8 @@ find_in_room (const room_t* r, const char* arg)
 static void 
 insert_object_at (object_t* o, room_t* r, int32_t x, int32_t y)
 {
+    object_t** chain;	/* name index chain for object */
+
     /* Remove object from its current room, if any. */
     remove_object (o);
 
@@ -519,10 +300,17 @@ insert_object_at (object_t* o, room_t* r, int32_t x, int32_t y)
     o->x = x;
     o->y = y;
 
-    /* Now add the object to the new room's contents. */
+    /* Now add the object to the new room's contents and the name index. */
     o->loc = r;
     o->next = r->contents;
     r->contents = o;
+    chain = name_chain (r, o->name_hash);
+    o->name_next = *chain;
+    *chain = o;
+
+    /* The object's new area must be redrawn. */
+    r->stale = 1;
+    mark_dirty (r, o);
 }
 
 
@@ -548,12 +336,12 @@ insert_object (object_t* o, room_t* r)
 
 
     /* Choose a random x location. */
-    range = photo_width (r->view) - image_width (o->img);
+    range = r->view.width - o->w;
     xpos = (0 >= range ? 0 : (rand () % range));
 
     /* Place in the lowest quarter of the roo photo if the object fits... */
-    space = photo_height (r->view);
-    img_ht = image_height (o->img);
+    space = r->view.height;
+    img_ht = o->h;
     range = space / 4 - img_ht;
     if (0 >= range) {
 	/* Doesn't fit: try not to let the object fall off the bottom. */
@@ -568,6 +356,138 @@ insert_object (object_t* o, room_t* r)
 }
 
 
+/* 
+ * mark_dirty
+ *   DESCRIPTION: Record an object's bounding box as a changed region of a
+ *                room.  Call after the room's contents have changed.
+ *                Regions that overlap or touch an
+ *                existing region are merged into it; if no slot remains,
+ *                the whole room is marked as changed.
+ *   INPUTS: r -- the room
+ *           o -- the object (its position and image give the region)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+mark_dirty (room_t* r, const object_t* o)
+{
+    rect_t  box; /* object bounding box                 */
+    rect_t* d;   /* loop index over recorded regions    */
+    int32_t i;   /* loop index over recorded regions    */
+
+    box.x_lo = o->x;
+    box.y_lo = o->y;
+    box.x_hi = o->x + o->w;
+    box.y_hi = o->y + o->h;
+
+    if (DIRTY_ALL == r->n_dirty) {
+        return;
+    }
+
+    /* Merge with a region that overlaps or touches the new one. */
+    for (i = 0; r->n_dirty > i; i++) {
+	d = &r->dirty[i];
+	if (box.x_lo <= d->x_hi && d->x_lo <= box.x_hi &&
+	    box.y_lo <= d->y_hi && d->y_lo <= box.y_hi) {
+	    if (d->x_lo > box.x_lo) { d->x_lo = box.x_lo; }
+	    if (d->y_lo > box.y_lo) { d->y_lo = box.y_lo; }
+	    if (d->x_hi < box.x_hi) { d->x_hi = box.x_hi; }
+	    if (d->y_hi < box.y_hi) { d->y_hi = box.y_hi; }
+	    return;
+	}
+    }
+
+    /* Otherwise use a new slot, if there is one. */
+    if (MAX_DIRTY_RECTS == r->n_dirty) {
+        r->n_dirty = DIRTY_ALL;
+	return;
+    }
+    r->dirty[r->n_dirty++] = box;
+}
+
+
+/* 
+ * get_photo
+ *   DESCRIPTION: Get a room photo, reading it from its file if it has not
+ *                been read yet.
+ *   INPUTS: ref -- the photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: the photo
+ *   SIDE EFFECTS: may read the photo; stops the game if it cannot be read
+ *                 or is not the size given by the world file
+ */
+static photo_t*
+get_photo (photo_ref_t* ref)
+{
+    if (NULL == ref->photo) {
+	ref->photo = read_photo (&world_arena, ref->file);
+	if (NULL == ref->photo || ref->width != photo_width (ref->photo) ||
+	    ref->height != photo_height (ref->photo)) {
+	    fprintf (stderr, "Can't read room photo %s.\n", ref->file);
+	    PANIC ("can't read room photo");
+	}
+    }
+    return ref->photo;
+}
+
+
+/* 
+ * get_image
+ *   DESCRIPTION: Get an object's image, reading it from its file if it
+ *                has not been read yet.
+ *   INPUTS: o -- the object
+ *   OUTPUTS: none
+ *   RETURN VALUE: the object's image
+ *   SIDE EFFECTS: may read the image; stops the game if it cannot be read
+ *                 or is not the size given by the world file
+ */
+static image_t*
+get_image (object_t* o)
+{
+    if (NULL == o->img) {
+	o->img = read_obj_image (&world_arena, o->file);
+	if (NULL == o->img || o->w != image_width (o->img) ||
+	    o->h != image_height (o->img)) {
+	    fprintf (stderr, "Can't read object photo %s.\n", o->file);
+	    PANIC ("can't read object photo");
+	}
+    }
+    return o->img;
+}
+
+
+/* 
+ * sync_view
+ *   DESCRIPTION: Rebuild a room's view of its photo and contents (in
+ *                drawing order) for room_get_view, reading the photo and
+ *                object images if they have not been read yet.
+ *   INPUTS: r -- the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the room's view; may read images
+ */
+static void
+sync_view (room_t* r)
+{
+    room_view_t* rv = &r->shown; /* the room's view              */
+    object_t*    obj;            /* loop index over room objects */
+    int32_t      n;              /* number of objects in view    */
+
+    rv->photo = get_photo (&r->view);
+    for (n = 0, obj = r->contents; NULL != obj; n++, obj = obj->next) {
+	rv->x[n] = obj->x;
+	rv->y[n] = obj->y;
+	rv->w[n] = obj->w;
+	rv->h[n] = obj->h;
+	rv->pix[n] = image_pixels (get_image (obj));
+	rv->span[n] = image_spans (obj->img);
+    }
+    rv->n_obj = n;
+    r->stale = 0;
+}
+
+
 /* 
  * move_object_to_inventory
  *   DESCRIPTION: Move an object into the player's inventory.  Try to 
@@ -582,22 +502,23 @@ static void
 move_object_to_inventory (object_t* obj)
 {
     object_t* conf;	/* loop index over possible conflicts for a space */
+    uint32_t  used = 0;	/* grid spaces in use (bit 3 * row + column)      */
     int32_t   x;	/* loop index for 3x3 grid x positions            */
     int32_t   y;	/* loop index for 3x3 grid y positions            */
+    int32_t   space;	/* loop index over grid spaces                    */
 
-    /* 
-     * This approach is asymptotically slow (N^2), but there shouldn't be 
-     * much in inventory, so it doesn't matter.
-     */
-    for (y = 10; 160 >= y; y += 50) {
-        for (x = 10; 210 >= x; x += 100) {
-	    for (conf = room[R_INVENTORY].contents; NULL != conf; 
-	    	 conf = conf->next) {
-	        if (x == conf->x && y == conf->y) {
-		    break;
-		}
-	    }
-	    if (NULL == conf) {
+    /* Note the grid spaces taken, in one pass over the inventory. */
+    for (conf = room[R_INVENTORY].contents; NULL != conf; conf = conf->next) {
+	if (10 == conf->x % 100 && 210 >= conf->x &&
+	    10 == conf->y % 50 && 160 >= conf->y) {
+	    used |= 1UL << (3 * (conf->y / 50) + conf->x / 100);
+	}
+    }
+
+    /* Use the first free space, row by row. */
+    for (space = 0, y = 10; 160 >= y; y += 50) {
+        for (x = 10; 210 >= x; x += 100, space++) {
+	    if (0 == (used & (1UL << space))) {
 		insert_object_at (obj, &room[R_INVENTORY], x, y);
 		return;
 	    }
@@ -694,12 +615,13 @@ static void
 remove_object (object_t* o)
 {
     object_t** find;	/* loop index over pointers to objects in room */
+    room_t*    r;	/* room that held the object                   */
 
     /* Is object already in limbo? */
-    if (NULL != o->loc) {
+    if (NULL != (r = o->loc)) {
 
 	/* Remove from previous room (with safety check)... */
-	for (find = &o->loc->contents; NULL != *find; find = &(*find)->next) {
+	for (find = &r->contents; NULL != *find; find = &(*find)->next) {
 	    if (o == *find) {
 		/* We found the predecessor!  Unlink the object. */
 	        *find = o->next;
@@ -707,8 +629,21 @@ remove_object (object_t* o)
 	    }
 	}
 
+	/* ...and from the name index. */
+	for (find = name_chain (r, o->name_hash); NULL != *find; 
+	     find = &(*find)->name_next) {
+	    if (o == *find) {
+	        *find = o->name_next;
+		break;
+	    }
+	}
+
 	/* Mark the object's location as NULL. */
 	o->loc = NULL;
+
+	/* The area that the object covered must be redrawn. */
+	r->stale = 1;
+	mark_dirty (r, o);
     }
 }
 
@@ -749,12 +684,12 @@ obj_get_y (const object_t* obj)
  *   INPUTS: obj -- pointer to the object
  *   OUTPUTS: none
  *   RETURN VALUE: the object obj's image pointer
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: may read the image (see get_image)
  */
 image_t*
-obj_image (const object_t* obj)
+obj_image (object_t* obj)
 {
-    return obj->img;
+    return get_image (obj);
 }
 
 
@@ -812,12 +747,12 @@ room_name (const room_t* r)
  *   INPUTS: r -- pointer to the room
  *   OUTPUTS: none
  *   RETURN VALUE: a pointer to room r's photo
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: may read the photo (see get_photo)
  */
 photo_t*
-room_photo (const room_t* r)
+room_photo (room_t* r)
 {
-    return r->view;
+    return get_photo (&r->view);
 }
 
 
@@ -832,7 +767,7 @@ room_photo (const room_t* r)
 uint32_t 
 room_photo_height (const room_t* r)
 {
-    return photo_height (r->view);
+    return r->view.height;
 }
 
 
@@ -847,15 +782,62 @@ room_photo_height (const room_t* r)
 uint32_t 
 room_photo_width (const room_t* r)
 {
-    return photo_width (r->view);
+    return r->view.width;
+}
+
+
+/* 
+ * room_take_dirty
+ *   DESCRIPTION: Read and clear the record of changed regions of a room.
+ *   INPUTS: r -- pointer to the room
+ *   OUTPUTS: rect -- the changed regions, in room photo coordinates
+ *   RETURN VALUE: the number of regions written to rect, or -1 if the
+ *                 whole room must be redrawn
+ *   SIDE EFFECTS: marks the room as unchanged
+ */
+int32_t
+room_take_dirty (room_t* r, rect_t rect[MAX_DIRTY_RECTS])
+{
+    int32_t n; /* number of regions recorded */
+
+    n = r->n_dirty;
+    if (0 < n) {
+	(void)memcpy (rect, r->dirty, n * sizeof (r->dirty[0]));
+    }
+    r->n_dirty = 0;
+    return n;
+}
+
+
+/* 
+ * room_get_view
+ *   DESCRIPTION: Copy the photo and the positions and images of the
+ *                objects in a room into a view, which can then be drawn
+ *                without reference to the room.  The room keeps its 
+ *                own view, rebuilt (see sync_view) only when its photo
+ *                or contents have changed since the last copy.
+ *   INPUTS: r -- pointer to the room
+ *   OUTPUTS: rv -- the view
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may read the room's photo and object images
+ */
+void
+room_get_view (room_t* r, room_view_t* rv)
+{
+    if (r->stale) {
+	sync_view (r);
+    }
+    *rv = r->shown;
 }
 
 
 /* 
  * build_world
- *   DESCRIPTION: Builds and connects the rooms, creates objects, and 
- *                reads in all image data (could be done lazily with 
- *                caching instead).
+ *   DESCRIPTION: Builds and connects the rooms and creates objects from
+ *                the world file, which is mapped and checked in a single
+ *                pass over its records.  Room photos and object images
+ *                are not read until a room is first shown (see 
+ *                room_get_view).
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: 1 on success, or 0 on failure
@@ -864,117 +846,114 @@ room_photo_width (const room_t* r)
 int32_t
 build_world ()
 {
-    int32_t idx;	/* index over data arrays   */
-    int32_t which;	/* id for current data item */
+    const world_header_t* h;  /* world file header          */
+    const world_room_t*   wr; /* room records               */
+    const world_obj_t*    wo; /* object records             */
+    const world_photo_t*  ws; /* swap photo records         */
+    int32_t               idx; /* index over records        */
 
     /* Clear all accomplishment flags. */
     (void)memset (player_flags, 0, sizeof (player_flags));
 
-    /* Clear room data to enable sanity check for duplication. */
-    (void)memset (room, 0, sizeof (room));
-
-    /* Loop over room data. */
-    for (idx = 0; N_ROOMS > idx; idx++) {
-	
-	/* Set the room id. */
-	which = room_data[idx].id;
+    /* Empty the name index. */
+    (void)memset (name_index, 0, sizeof (name_index));
 
-	/* Check for bad and duplicate ids. */
-	if (0 > which || N_ROOMS <= which) {
-	    fputs ("Bad index in room data.\n", stderr);
-	    return 0;
-	}
-	if (NULL != room[which].name) {
-	    fprintf (stderr, "Duplicate index %d in room data.\n", which);
-	    return 0;
-	}
+    /* 
+     * Map the image pack, if there is one.  Images missing from it (or 
+     * all of them, without it) are read from their own files.
+     */
+    (void)pack_open (PACK_FILE);
 
-	/* Set up the room. */
-        room[which].name = room_data[idx].name;
-	room[which].view = read_photo (room_data[idx].filename);
-	if (NULL == room[which].view) {
-	    fprintf (stderr, "Can't read room photo %s.\n", 
-	    	     room_data[idx].filename);
-	    return 0;
-	}
-	room[which].contents = NULL;
-	room[which].left  = (R_NONE == room_data[idx].left ? NULL : 
-			     &room[room_data[idx].left]);
-	room[which].enter = (R_NONE == room_data[idx].enter ? NULL : 
-			     &room[room_data[idx].enter]);
-	room[which].right = (R_NONE == room_data[idx].right ? NULL : 
-			     &room[room_data[idx].right]);
+    /* Map the world file and find its record arrays. */
+    if (NULL == (h = map_world (WORLD_FILE))) {
+	fprintf (stderr, "Can't read world file %s.\n", WORLD_FILE);
+	return 0;
+    }
+    n_rooms = h->n_rooms;
+    n_objects = h->n_objects;
+    wr = (const world_room_t*)(h + 1);
+    wo = (const world_obj_t*)(wr + n_rooms);
+    ws = (const world_photo_t*)(wo + n_objects);
+
+    /* Room views must be able to hold every object. */
+    if (MAX_VIEW_OBJECTS < n_objects) {
+	fputs ("Too many objects for room views.\n", stderr);
+	return 0;
     }
 
-    /* Clear object data to enable sanity check for duplication. */
-    (void)memset (object, 0, sizeof (object));
-
-    /* Loop over object data. */
-    for (idx = 0; N_OBJECTS > idx; idx++) {
-
-	/* Set the object id. */
-	which = obj_data[idx].id;
+    /* 
+     * The rooms and objects are sized by the world file, which may add
+     * rooms and objects beyond those the game refers to by name.  The 
+     * arena fills them with zeroes.
+     */
+    if (NULL == (room = arena_alloc (&world_arena, 
+    				     n_rooms * sizeof (room[0]))) ||
+	NULL == (object = arena_alloc (&world_arena, 
+				       n_objects * sizeof (object[0])))) {
+	fputs ("Out of memory for rooms and objects.\n", stderr);
+	return 0;
+    }
 
-	/* Check for bad and duplicate ids. */
-	if (0 > which || N_OBJECTS <= which) {
-	    fputs ("Bad index in object data.\n", stderr);
-	    return 0;
-	}
-	if (NULL != object[which].name) {
-	    fprintf (stderr, "Duplicate index %d in object data.\n", which);
+    /* 
+     * Set up the rooms.  mp2world has already checked that each is 
+     * described once, so only the records' contents need checking.
+     */
+    for (idx = 0; n_rooms > idx; idx++) {
+	if (bad_string (wr[idx].name) || bad_string (wr[idx].photo.file) ||
+	    bad_room_id (wr[idx].left) || bad_room_id (wr[idx].enter) ||
+	    bad_room_id (wr[idx].right)) {
+	    fprintf (stderr, "Bad room %d in world file.\n", idx);
 	    return 0;
 	}
+        room[idx].name = world_str + wr[idx].name;
+	set_photo_ref (&room[idx].view, &wr[idx].photo);
+	room[idx].contents = NULL;
+	room[idx].left  = (R_NONE == wr[idx].left ? NULL : 
+			   &room[wr[idx].left]);
+	room[idx].enter = (R_NONE == wr[idx].enter ? NULL : 
+			   &room[wr[idx].enter]);
+	room[idx].right = (R_NONE == wr[idx].right ? NULL : 
+			   &room[wr[idx].right]);
+	room[idx].stale = 1;
+    }
 
-	/* Set up the object. */
-        object[which].name = obj_data[idx].name;
-	object[which].img = read_obj_image (obj_data[idx].filename);
-	if (NULL == object[which].img) {
-	    fprintf (stderr, "Can't read object photo %s.\n", 
-	    	     obj_data[idx].filename);
+    /* Set up the objects, placing them in their starting rooms. */
+    for (idx = 0; n_objects > idx; idx++) {
+	if (bad_string (wo[idx].name) || bad_string (wo[idx].image.file) ||
+	    bad_room_id (wo[idx].room) || -1 > wo[idx].x || -1 > wo[idx].y) {
+	    fprintf (stderr, "Bad object %d in world file.\n", idx);
 	    return 0;
 	}
-        object[which].next = NULL;
-        object[which].loc = NULL;
-        object[which].x = 0;
-        object[which].y = 0;
+        object[idx].name = world_str + wo[idx].name;
+	object[idx].name_hash = hash_name (object[idx].name);
+	object[idx].file = world_str + wo[idx].image.file;
+	object[idx].w = wo[idx].image.width;
+	object[idx].h = wo[idx].image.height;
+	object[idx].img = NULL;
+        object[idx].next = NULL;
+        object[idx].name_next = NULL;
+        object[idx].loc = NULL;
+        object[idx].x = 0;
+        object[idx].y = 0;
 
 	/* Insert it into a room if necessary. */
-	if (R_NONE != obj_data[idx].room) {
-	    if (-1 != obj_data[idx].x) {
-	        insert_object_at (&object[which], &room[obj_data[idx].room],
-				  obj_data[idx].x, obj_data[idx].y);
+	if (R_NONE != wo[idx].room) {
+	    if (-1 != wo[idx].x) {
+	        insert_object_at (&object[idx], &room[wo[idx].room],
+				  wo[idx].x, wo[idx].y);
 	    } else {
-	        insert_object (&object[which], &room[obj_data[idx].room]);
+	        insert_object (&object[idx], &room[wo[idx].room]);
 	    }
 	}
     }
 
-    /* Clear swap photo data to enable sanity check for duplication. */
-    (void)memset (swap_photo, 0, sizeof (swap_photo));
-
-    /* Loop over swap photo data. */
+    /* Set up the swap photos. */
     for (idx = 0; N_SWAPS > idx; idx++) {
-
-	/* Set the swap photo id. */
-	which = swap_data[idx].id;
-
-	/* Check for bad and duplicate ids. */
-	if (0 > which || N_SWAPS <= which) {
-	    fputs ("Bad index in swap data.\n", stderr);
-	    return 0;
-	}
-	if (NULL != swap_photo[which]) {
-	    fprintf (stderr, "Duplicate index %d in swap data.\n", which);
-	    return 0;
-	}
-
-	/* Read in the swap photo. */
-	swap_photo[which] = read_photo (swap_data[idx].filename);
-	if (NULL == swap_photo[which]) {
-	    fprintf (stderr, "Can't read room photo %s.\n", 
-	    	     swap_data[idx].filename);
+	if (bad_string (ws[idx].file)) {
+	    fprintf (stderr, "Bad swap photo %d in world file.\n", idx);
 	    return 0;
 	}
+	set_photo_ref (&swap_photo[idx], &ws[idx]);
     }
 
     /* Everything worked! */
@@ -982,6 +961,150 @@ build_world ()
 }
 
 
+/* 
+ * map_world
+ *   DESCRIPTION: Map the world file and check its header: there must
+ *                be a record for every room and object this program 
+ *                refers to by name (and possibly more), one for each 
+ *                swap photo, and the string table must fill the rest of
+ *                the file and end with a NUL.
+ *   INPUTS: fname -- world file name
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the world file header, or NULL on failure
+ *   SIDE EFFECTS: maps the world file (unmapped by free_world)
+ */
+static const world_header_t*
+map_world (const char* fname)
+{
+    int                   fd;   /* world file descriptor  */
+    struct stat           st;   /* world file status      */
+    void*                 map;  /* mapping of world file  */
+    const world_header_t* h;    /* world file header      */
+    size_t                recs; /* bytes before strings   */
+
+    if (0 > (fd = open (fname, O_RDONLY))) {
+        return NULL;
+    }
+    if (0 != fstat (fd, &st) || sizeof (*h) >= (size_t)st.st_size ||
+	MAP_FAILED == (map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+				   fd, 0))) {
+	(void)close (fd);
+	return NULL;
+    }
+    (void)close (fd);
+
+    h = map;
+    recs = sizeof (*h) + h->n_rooms * sizeof (world_room_t) + 
+	   h->n_objects * sizeof (world_obj_t) + 
+	   h->n_swaps * sizeof (world_photo_t);
+    world_str = (const char*)map + recs;
+    if (WORLD_MAGIC != h->magic || WORLD_VERSION != h->version ||
+	N_ROOMS > h->n_rooms || N_OBJECTS > h->n_objects ||
+	N_SWAPS != h->n_swaps || recs >= (size_t)st.st_size ||
+	st.st_size - recs != h->str_size ||
+	'\0' != world_str[h->str_size - 1]) {
+	(void)munmap (map, st.st_size);
+	return NULL;
+    }
+    world_map = map;
+    world_size = st.st_size;
+    world_str_size = h->str_size;
+    return h;
+}
+
+
+/* 
+ * bad_string
+ *   DESCRIPTION: Check a string offset from the world file.
+ *   INPUTS: off -- offset into the string table
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the offset is outside the table, or 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t
+bad_string (uint32_t off)
+{
+    /* The table ends with a NUL, so every string in it is terminated. */
+    return (world_str_size <= off);
+}
+
+
+/* 
+ * bad_room_id
+ *   DESCRIPTION: Check a room id from the world file.
+ *   INPUTS: id -- room id or R_NONE
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the id is not a room or R_NONE, or 0 if it is
+ *   SIDE EFFECTS: none
+ */
+static int32_t
+bad_room_id (int32_t id)
+{
+    return (R_NONE > id || n_rooms <= id);
+}
+
+
+/* 
+ * set_photo_ref
+ *   DESCRIPTION: Set up a room photo from its world file record, without
+ *                reading the photo.
+ *   INPUTS: wp -- the record (with file name checked)
+ *   OUTPUTS: ref -- the photo
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+set_photo_ref (photo_ref_t* ref, const world_photo_t* wp)
+{
+    ref->file = world_str + wp->file;
+    ref->width = wp->width;
+    ref->height = wp->height;
+    ref->photo = NULL;
+}
+
+
+/* 
+ * free_world
+ *   DESCRIPTION: Free all rooms, objects, room photos, and object images
+ *                at once, and unmap the world file.  The world must not be used again
+ *                unless rebuilt.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees the world's arena
+ */
+void
+free_world ()
+{
+    room = NULL;
+    object = NULL;
+    n_rooms = n_objects = 0;
+    (void)memset (swap_photo, 0, sizeof (swap_photo));
+    (void)memset (name_index, 0, sizeof (name_index));
+    arena_release (&world_arena);
+    if (NULL != world_map) {
+	(void)munmap ((void*)world_map, world_size);
+	world_map = NULL;
+    }
+}
+
+
+/* 
+ * get_world_memory
+ *   DESCRIPTION: Get the counters of the arena holding the world's room
+ *                photos and object images.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the arena (read-only)
+ *   SIDE EFFECTS: none
+ */
+const arena_t*
+get_world_memory ()
+{
+    return &world_arena;
+}
+
+
 /* 
  * start_in_room
  *   DESCRIPTION: Get a pointer to the room in which the player begins 
@@ -36,23 +36,79 @@
 #define WORLD_H
 
 
+#include "arena.h"
 #include "types.h"
 
 
+/*
+ * Typed commands that move objects record the changed parts of each room
+ * photo (the old and new bounding boxes of the objects), so that only the
+ * lines covering them need to be redrawn.  Rectangles are in room photo
+ * coordinates; the lo bounds are inclusive and the hi bounds exclusive.
+ */
+#define MAX_DIRTY_RECTS 4   /* beyond this, the whole room is dirty */
+
+typedef struct rect_t rect_t;
+struct rect_t {
+    int32_t x_lo, y_lo;
+    int32_t x_hi, y_hi;
+};
+
+/*
+ * A copy of what a room looks like: its photo and the position, size,
+ * and image data of each of its objects, in drawing order.  A view can be
+ * drawn while the game goes on changing the room itself (see render.c).
+ * Objects are stored as parallel arrays so that drawing can walk each
+ * field in order, without following pointers from object to object.
+ * Each room keeps its view up to date as its contents change.
+ */
+#define MAX_VIEW_OBJECTS 32  /* must be at least the number of objects */
+
+typedef struct room_view_t room_view_t;
+struct room_view_t {
+    const photo_t*      photo;                  /* room photo            */
+    int32_t             n_obj;                  /* number of objects     */
+    int32_t             x[MAX_VIEW_OBJECTS];    /* positions in room     */
+    int32_t             y[MAX_VIEW_OBJECTS];    /*   photo coordinates   */
+    int32_t             w[MAX_VIEW_OBJECTS];    /* image sizes in pixels */
+    int32_t             h[MAX_VIEW_OBJECTS];
+    const uint8_t*      pix[MAX_VIEW_OBJECTS];  /* image pixels          */
+    const image_span_t* span[MAX_VIEW_OBJECTS]; /* opaque span of each   */
+    						/*   image row           */
+};
+
 /* structure access functions */
 extern uint16_t obj_get_x (const object_t* obj);
 extern uint16_t obj_get_y (const object_t* obj);
-extern image_t* obj_image (const object_t* obj);
+extern image_t* obj_image (object_t* obj);
 extern object_t* obj_next (const object_t* obj);
 extern object_t* room_contents_iterate (const room_t* r);
 extern const char* room_name (const room_t* r);
-extern photo_t* room_photo (const room_t* r);
+extern photo_t* room_photo (room_t* r);
 extern uint32_t room_photo_height (const room_t* r);
 extern uint32_t room_photo_width (const room_t* r);
 
+/* 
+ * Read and clear the changed regions of a room.  Returns the number of
+ * rectangles written to rect, or -1 if the whole room must be redrawn.
+ */
+extern int32_t room_take_dirty (room_t* r, rect_t rect[MAX_DIRTY_RECTS]);
+
+/* 
+ * Copy the photo and object positions of a room into a view (reading the
+ * photo and images the first time the room is shown).
+ */
+extern void room_get_view (room_t* r, room_view_t* rv);
+
 /* Build the game world.  Returns 0 on failure, or 1 on success. */
 extern int32_t build_world (void);
 
+/* Free the world's photos and images (use the world no more after). */
+extern void free_world (void);
+
+/* Get the arena holding the world's photos and images (for counters). */
+extern const arena_t* get_world_memory (void);
+
 /* Get pointer to starting room for player. */
 extern room_t* start_in_room (void);
 
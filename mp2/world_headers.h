@@ -0,0 +1,205 @@
+/*									tab:8
+ *
+ * world_headers.h - header file defining the world description file 
+ *                   format and the identifiers used in it
+ *
+ * Filename:	    world_headers.h
+ */
+
+#if !defined(WORLD_HEADERS_H)
+#define WORLD_HEADERS_H
+
+
+#include <stdint.h>
+
+
+/*
+ * Rooms, objects, and swap photos are numbered by the identifiers below,
+ * which the game logic in world.c uses by name.  The world description
+ * (world.def) refers to them by the same names; mp2world compiles it
+ * into a binary world file (world.bin) for build_world to map.
+ */
+
+/* 
+ * Each identifier list below is an X-macro: ID is applied to every 
+ * identifier in order, giving both the enum here and mp2world's table of
+ * names, so that the two cannot disagree.
+ */
+#define ENUM_ID(id) id,
+
+/* room identifiers */
+#define ROOM_IDS(ID)                                                        \
+    /* Area 0: The Backpack */                                              \
+    ID (R_INVENTORY)                                                        \
+                                                                            \
+    /* Area 1: Everitt and Green Street */                                  \
+    ID (R_IN_391LAB)    /* inside the 391 lab               */              \
+    ID (R_BY_391LAB)    /* outside of the 391 lab           */              \
+    ID (R_IN_IEEE)      /* inside the IEEE/HKN office       */              \
+    ID (R_BY_IEEE)      /* outside of the IEEE/HKN office   */              \
+    ID (R_IN_395LAB)    /* inside the 395 lab               */              \
+    ID (R_BY_395LAB)    /* outside of the 395 lab           */              \
+    ID (R_EVT_STAIR)    /* Everitt Lab's eastern stairwell  */              \
+    ID (R_IN_CLEANR)    /* inside the cleanroom             */              \
+    ID (R_BY_CLEANR)    /* outside of the cleanroom         */              \
+    ID (R_EVRT_VEND)    /* near the Everitt vending machine */              \
+    ID (R_ALMAMATER)    /* near the Alma Mater statue       */              \
+    ID (R_IN_COCOMR)    /* inside of Cocomero               */              \
+    ID (R_BY_COCOMR)    /* just outside of Cocomero         */              \
+    ID (R_BY_ZAS)       /* across from the ruins of Za's    */              \
+    ID (R_EAST_EVRT)    /* East entrance of Everitt Lab     */              \
+    ID (R_EVRT_BSMT)    /* entrance to Everitt Lab basement */              \
+                                                                            \
+    /* Area 2: Bardeen Quad and Environs */                                 \
+    ID (R_WEST_BONE)    /* looking West along the Boneyard   */             \
+    ID (R_CIRCLE_N)     /* Boneyard Bridge looking North     */             \
+    ID (R_CIRCLE_SW)    /* Boneyard Bridge looking Southwest */             \
+    ID (R_EAST_BONE)    /* looking East along the Boneyard   */             \
+    ID (R_BARDEEN)      /* Bardeen Quad                      */             \
+    ID (R_LIB_BACK)     /* rear of Grainger library          */             \
+    ID (R_RESERVE)      /* Grainger reserve desk             */             \
+    ID (R_TALBOT_NW)    /* looking Northwest at Talbot       */             \
+    ID (R_TALBOT_SW)    /* looking Southwest at Talbot       */             \
+    ID (R_TALBOT)       /* inside Talbot Laboratory          */             \
+    ID (R_SPRINGFLD)    /* looking West along Springfield    */             \
+    ID (R_CARIBOU)      /* the Caribou coffee shop           */             \
+    ID (R_KENNEY)       /* Kenney Gym                        */             \
+    ID (R_DCL)          /* Digital Computer Laboratory       */             \
+    ID (R_LIB_FRONT)    /* front of Grainger library         */             \
+                                                                            \
+    /* Area 3: CSL and Environs */                                          \
+    ID (R_KENNEY_E)     /* East of Kenney Gym                */             \
+    ID (R_NEWMARK)      /* Newmark Laboratory                */             \
+    ID (R_MNTL_NW)      /* looking Northwest at MNTL         */             \
+    ID (R_MNTL_SW)      /* looking Southwest at MNTL         */             \
+    ID (R_MNTLLOBBY)    /* the lobby of MNTL                 */             \
+    ID (R_MNTL_LAB1)    /* a laboratory within MNTL (#1)     */             \
+    ID (R_MNTL_LAB2)    /* a laboratory within MNTL (#2)     */             \
+    ID (R_MNTL_LAB3)    /* a laboratory within MNTL (#3)     */             \
+    ID (R_CSL_VIEW)     /* Coordinated Science Laboratory    */             \
+    ID (R_CSL_DOOR)     /* the CSL main entrance             */             \
+    ID (R_CSL_LOBBY)    /* in the CSL lobby                  */             \
+    ID (R_CSL_UPPER)    /* on an upper floor of CSL          */             \
+    ID (R_CSLLOUNGE)    /* in the new CSL lounge area        */             \
+    ID (R_BECK_LOT)     /* the Beckman Circle parking lot    */             \
+    ID (R_BECKMAN)      /* the Beckman Institute             */             \
+    ID (R_BECK_DOOR)    /* Beckman main entrance             */             \
+    ID (R_BECKLOBBY)    /* in the lobby of Beckman           */             \
+    ID (R_BECK_MRI)     /* an MRI machine ... somewhere      */             \
+                                                                            \
+    /* Area 4: The Rest of the World, Featuring the Remote Sensing Lab */   \
+    ID (R_GARAGE)       /* the campus parking structure      */             \
+    ID (R_CAR_SITE)     /* the (fictitious) ECE391 car       */             \
+    ID (R_ALLERTON)     /* the Allerton mansion              */             \
+    ID (R_FU_DOGS)      /* the Fu dogs at Allerton           */             \
+    ID (R_STATUE)       /* a statue near the Fu dogs         */             \
+    ID (R_SUNSINGER)    /* the Allerton Sun Singer statue    */             \
+    ID (R_WILLARD)      /* Willard Airport fountain view     */             \
+    ID (R_WILL_SIDE)    /* side view of Willard and tower    */             \
+    ID (R_REM_PLANE)    /* a sensor-laden plane              */             \
+    ID (R_COCKPIT)      /* cockpit of remote sensing plane   */             \
+    ID (R_OVER_WILL)    /* flying above Willard Airport      */             \
+    ID (R_AIR_RIO)      /* view of Rio de Janeiro from air   */             \
+    ID (R_REM_ICE)      /* the ice fields near rem. sen. lab */             \
+    ID (R_REM_LAB)      /* part of a remote sensing lab      */
+
+enum {
+    R_NONE = -1,
+    ROOM_IDS (ENUM_ID)
+    N_ROOMS
+};
+
+/* object identifiers */
+#define OBJECT_IDS(ID)                                                      \
+    ID (O_BOARD)        /* a motorized mountain board                 */    \
+    ID (O_JETPACK)      /* Buzz Lightyear: to Infinity ...            */    \
+    ID (O_TUX)          /* Tux: our mascot                            */    \
+    ID (O_MP2)          /* the MP2 specification (covers mode X)      */    \
+    ID (O_BOOK_C)       /* the C programming language                 */    \
+    ID (O_BOOK_WODE)    /* stories by P.G. Wodehouse                  */    \
+    ID (O_GPS_BAD)      /* a malfunctioning GPS device                */    \
+    ID (O_GPS_GOOD)     /* a working GPS device                       */    \
+    ID (O_GPS_SPEC)     /* GPS chip data sheet (specifications)       */    \
+    ID (O_BUNNYSUIT)    /* a pink bunny suit                          */    \
+    ID (O_BATT_EMPTY)   /* an uncharged car battery                   */    \
+    ID (O_BATT_FULL)    /* a fully charged car battery                */    \
+    ID (O_BATT_CAR)     /* battery as it appears in the car           */    \
+    ID (O_MTN_DEW)      /* a bottle of dew                            */    \
+    ID (O_FISH)         /* a fish to lure penguins                    */    \
+    ID (O_ICARD)        /* an I-card                                  */    \
+    ID (O_CAR_KEY)      /* the keys to a car                          */    \
+    ID (O_ROBOT_DEAD)   /* a buggy lockpicking robot                  */    \
+    ID (O_ROBOT_LIVE)   /* lockpicking robot with new control program */    \
+    ID (O_MIMO_CARD)    /* a MIMO card for planes                     */
+
+enum {
+    O_NONE = -1,
+    OBJECT_IDS (ENUM_ID)
+    N_OBJECTS
+};
+
+/* identifiers for rooms with photo swapping */
+#define SWAP_IDS(ID)                                                        \
+    ID (SWAP_CIRCLE)    /* Boneyard Creek Bridge photo swap */              \
+    ID (SWAP_CAR)       /* open/closed hood                 */
+
+enum {
+    SWAP_IDS (ENUM_ID)
+    N_SWAPS
+};
+
+
+/*
+ * The binary world file holds a world_header_t, then one world_room_t 
+ * per room, one world_obj_t per object, and one world_photo_t per swap
+ * photo, each array indexed by identifier, and finally a string table
+ * of NUL-terminated names.  Rooms and objects numbered from N_ROOMS and
+ * N_OBJECTS come from the world description alone.  Names are given as
+ * offsets into the string table.  Photo and image sizes are copied from the image files so that
+ * the game can lay out a room without reading its images.  All values
+ * are little-endian.
+ */
+
+#define WORLD_FILE    "world.bin"
+#define WORLD_MAGIC   0x444C5257 /* "WRLD" in a little-endian file */
+#define WORLD_VERSION 1
+
+typedef struct world_header_t world_header_t;
+struct world_header_t {
+    uint32_t magic;     /* WORLD_MAGIC                   */
+    uint32_t version;   /* WORLD_VERSION                 */
+    uint16_t n_rooms;   /* at least N_ROOMS              */
+    uint16_t n_objects; /* at least N_OBJECTS            */
+    uint16_t n_swaps;   /* must be N_SWAPS               */
+    uint16_t unused;    /* zero                          */
+    uint32_t str_size;  /* bytes in string table         */
+};
+
+typedef struct world_photo_t world_photo_t;
+struct world_photo_t {
+    uint32_t file;          /* photo file name              */
+    uint16_t width, height; /* photo size in pixels         */
+};
+
+typedef struct world_room_t world_room_t;
+struct world_room_t {
+    uint32_t      name;     /* room name                    */
+    world_photo_t photo;    /* room photo                   */
+    int16_t       left;     /* room to 'left' or R_NONE     */
+    int16_t       enter;    /* room reached by 'enter'      */
+    int16_t       right;    /* room to 'right'              */
+    int16_t       unused;   /* zero                         */
+};
+
+typedef struct world_obj_t world_obj_t;
+struct world_obj_t {
+    uint32_t      name;     /* object keyword               */
+    world_photo_t image;    /* object image                 */
+    int16_t       room;     /* starting room or R_NONE      */
+    int16_t       x;        /* starting x position (-1 for  */
+    			    /*   random)                    */
+    int16_t       y;        /* starting y position          */
+    int16_t       unused;   /* zero                         */
+};
+
+#endif /* WORLD_HEADERS_H */